@@ -0,0 +1,145 @@
+#ifndef BATCH_IMPORT_H
+#define BATCH_IMPORT_H
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "import_report.hpp"
+#include "model_loader.hpp"
+#include "timing.hpp"
+
+// Batch import throughput: imports every FBX file found under a directory on N worker
+// threads, CPU side only (no GL context), and reports files/s, MB/s and the stage breakdown
+// of the slowest assets. Every import has its own ASSIMP importer, so workers share nothing.
+
+namespace BatchImport
+{
+    inline bool hasExtension(const std::string& name, const char* extension)
+    {
+        std::string lower(name);
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        size_t length = std::string(extension).size();
+        return lower.size() >= length && lower.compare(lower.size() - length, length, extension) == 0;
+    }
+
+    // appends the files under directory with the extension (lower case, e.g. ".fbx"), recursively
+    inline void FindFiles(const std::string& directory, const char* extension, std::vector<std::string>& files)
+    {
+#ifdef _WIN32
+        WIN32_FIND_DATAA data;
+        HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &data);
+        if (find == INVALID_HANDLE_VALUE)
+            return;
+        do
+        {
+            std::string name(data.cFileName);
+            if (name == "." || name == "..")
+                continue;
+            std::string path = directory + "/" + name;
+            if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                FindFiles(path, extension, files);
+            else if (hasExtension(name, extension))
+                files.push_back(path);
+        } while (FindNextFileA(find, &data));
+        FindClose(find);
+#else
+        DIR* dir = opendir(directory.c_str());
+        if (dir == nullptr)
+            return;
+        while (dirent* entry = readdir(dir))
+        {
+            std::string name(entry->d_name);
+            if (name == "." || name == "..")
+                continue;
+            std::string path = directory + "/" + name;
+            struct stat info;
+            if (stat(path.c_str(), &info) != 0)
+                continue;
+            if (S_ISDIR(info.st_mode))
+                FindFiles(path, extension, files);
+            else if (hasExtension(name, extension))
+                files.push_back(path);
+        }
+        closedir(dir);
+#endif
+    }
+
+    // imports the files on threads workers, one report per file in the same order
+    inline double Run(const std::vector<std::string>& files, unsigned int threads, std::vector<ImportReport>& reports)
+    {
+        reports.assign(files.size(), ImportReport());
+        std::atomic<size_t> next(0);
+        Timer wall;
+
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < threads; t++)
+        {
+            workers.push_back(std::thread([&files, &reports, &next]()
+            {
+                for (size_t i = next.fetch_add(1); i < files.size(); i = next.fetch_add(1))
+                {
+                    ModelLoadOptions options;
+                    options.UploadToGPU = false;
+                    options.Residency = ResidencyPolicy::ReleaseAfterUpload;
+                    options.Report = &reports[i];
+                    LoadModelFromFilename(files[i], options);
+                }
+            }));
+        }
+        for (unsigned int t = 0; t < workers.size(); t++)
+            workers[t].join();
+        return wall.ElapsedMilliseconds();
+    }
+
+    inline bool slower(const ImportReport* a, const ImportReport* b) { return a->TotalMilliseconds > b->TotalMilliseconds; }
+
+    inline void PrintSummary(std::ostream& out, const std::vector<ImportReport>& reports, unsigned int threads, double milliseconds, unsigned int slowest)
+    {
+        // failed imports are listed but left out of the throughput
+        uint64_t bytes = 0;
+        double busy = 0.0;
+        std::vector<const ImportReport*> sorted, failed;
+        for (unsigned int i = 0; i < reports.size(); i++)
+        {
+            if (!reports[i].Imported)
+            {
+                failed.push_back(&reports[i]);
+                continue;
+            }
+            bytes += reports[i].GetCount("file bytes");
+            busy += reports[i].TotalMilliseconds;
+            sorted.push_back(&reports[i]);
+        }
+        double seconds = milliseconds / 1000.0;
+        out << "Imported " << sorted.size() << " files (" << bytes / (1024.0 * 1024.0) << " MB) on " << threads << " threads in "
+            << milliseconds << " ms: " << (seconds > 0.0 ? sorted.size() / seconds : 0.0) << " files/s, "
+            << (seconds > 0.0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0) << " MB/s, worker utilization "
+            << (milliseconds > 0.0 ? (int)(busy / (milliseconds * threads) * 100.0 + 0.5) : 0) << "%" << std::endl;
+        if (!failed.empty())
+            out << "Failed to import " << failed.size() << " files:" << std::endl;
+        for (unsigned int i = 0; i < failed.size(); i++)
+            out << "  " << failed[i]->Asset << std::endl;
+
+        std::sort(sorted.begin(), sorted.end(), slower);
+        if (slowest > sorted.size())
+            slowest = (unsigned int)sorted.size();
+        if (slowest > 0)
+            out << "Slowest " << slowest << " imports:" << std::endl;
+        for (unsigned int i = 0; i < slowest; i++)
+            sorted[i]->Print(out);
+    }
+}
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef GOLDEN_H
+#define GOLDEN_H
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "animation.hpp"
+#include "model.hpp"
+
+// Golden pose regression: every clip of an asset is sampled at fixed times and the resulting
+// palettes are compared with the ones stored in <golden dir>/<asset>.pose. Lets aggressive
+// optimizations of the animation code land with their output checked against the reference.
+
+namespace Golden
+{
+    // fractions of the clip length each clip is sampled at
+    const unsigned int SAMPLES_PER_CLIP = 8;
+
+    struct PoseSample
+    {
+        unsigned int Clip;
+        float Time; // seconds
+        std::vector<glm::mat4> Palette;
+    };
+
+    inline std::vector<PoseSample> SamplePoses(const Model& model)
+    {
+        std::vector<PoseSample> samples;
+        Pose pose;
+        pose.Resize(model.GetSkeleton());
+        for (unsigned int clip = 0; clip < model.GetNumAnimations(); clip++)
+        {
+            const AnimationClip& animation = model.GetAnimation(clip);
+            float duration = animation.Duration / animation.TicksPerSecond;
+            for (unsigned int k = 0; k < SAMPLES_PER_CLIP; k++)
+            {
+                PoseSample sample;
+                sample.Clip = clip;
+                sample.Time = duration * k / SAMPLES_PER_CLIP;
+                Animation::EvaluatePose(model.GetSkeleton(), animation, sample.Time, pose);
+                sample.Palette = pose.Palette;
+                samples.push_back(sample);
+            }
+        }
+        return samples;
+    }
+
+    // text format: one "clip time bones" header line per sample followed by one line of 16 floats per bone
+    inline bool Write(const std::string& path, const std::vector<PoseSample>& samples)
+    {
+        std::ofstream file(path.c_str());
+        if (!file)
+        {
+            std::cout << "ERROR::GOLDEN: Failed to write " << path << std::endl;
+            return false;
+        }
+        file.precision(9);
+        for (unsigned int s = 0; s < samples.size(); s++)
+        {
+            file << samples[s].Clip << ' ' << samples[s].Time << ' ' << samples[s].Palette.size() << '\n';
+            for (unsigned int b = 0; b < samples[s].Palette.size(); b++)
+            {
+                const glm::mat4& m = samples[s].Palette[b];
+                for (int c = 0; c < 4; c++)
+                    for (int r = 0; r < 4; r++)
+                        file << m[c][r] << (c == 3 && r == 3 ? '\n' : ' ');
+            }
+        }
+        return true;
+    }
+
+    inline bool Read(const std::string& path, std::vector<PoseSample>& samples)
+    {
+        std::ifstream file(path.c_str());
+        if (!file)
+            return false;
+        PoseSample sample;
+        size_t bones;
+        while (file >> sample.Clip >> sample.Time >> bones)
+        {
+            sample.Palette.resize(bones);
+            for (unsigned int b = 0; b < bones; b++)
+                for (int c = 0; c < 4; c++)
+                    for (int r = 0; r < 4; r++)
+                        file >> sample.Palette[b][c][r];
+            if (!file)
+                return false;
+            samples.push_back(sample);
+        }
+        return true;
+    }
+
+    inline bool Exists(const std::string& path)
+    {
+        std::ifstream file(path.c_str());
+        return file.good();
+    }
+
+    // compares the model's current output with the stored palettes, reports the worst mismatch
+    inline bool Verify(const std::string& asset, const std::string& path, const Model& model, float tolerance)
+    {
+        std::vector<PoseSample> expected;
+        if (!Read(path, expected))
+        {
+            std::cout << "ERROR::GOLDEN: " << asset << ": missing or unreadable " << path << " (run with --update-golden)" << std::endl;
+            return false;
+        }
+        std::vector<PoseSample> actual = SamplePoses(model);
+        if (actual.size() != expected.size())
+        {
+            std::cout << "ERROR::GOLDEN: " << asset << ": " << actual.size() << " samples, golden has " << expected.size() << std::endl;
+            return false;
+        }
+
+        float worst = 0.0f;
+        unsigned int worstSample = 0, worstBone = 0;
+        for (unsigned int s = 0; s < actual.size(); s++)
+        {
+            if (actual[s].Clip != expected[s].Clip || actual[s].Palette.size() != expected[s].Palette.size())
+            {
+                std::cout << "ERROR::GOLDEN: " << asset << ": sample " << s << " doesn't match the golden layout" << std::endl;
+                return false;
+            }
+            for (unsigned int b = 0; b < actual[s].Palette.size(); b++)
+            {
+                for (int c = 0; c < 4; c++)
+                {
+                    for (int r = 0; r < 4; r++)
+                    {
+                        float error = std::fabs(actual[s].Palette[b][c][r] - expected[s].Palette[b][c][r]);
+                        if (!(error <= worst))
+                        {
+                            worst = error;
+                            worstSample = s;
+                            worstBone = b;
+                        }
+                    }
+                }
+            }
+        }
+
+        bool passed = worst <= tolerance;
+        std::cout << (passed ? "PASS " : "FAIL ") << asset << ": " << actual.size() << " poses, max error " << worst;
+        if (!passed)
+            std::cout << " at clip " << actual[worstSample].Clip << ", t = " << actual[worstSample].Time << " s, bone " << worstBone;
+        std::cout << " (tolerance " << tolerance << ")" << std::endl;
+        return passed;
+    }
+}
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef OCCLUSION_BENCH_H
+#define OCCLUSION_BENCH_H
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "bounds.hpp"
+#include "occlusion.hpp"
+#include "timing.hpp"
+#include "worker_pool.hpp"
+
+// Occlusion culling benchmark, CPU side only: a grid of character boxes with walls scattered
+// between them, seen from a camera walking around the crowd at head height. Reports the time
+// to rasterize the occluders and to test the boxes, and the share of the boxes in the view
+// that the walls hide.
+
+namespace OcclusionBench
+{
+    struct Result
+    {
+        unsigned int Instances;
+        unsigned int Walls;
+        SampleStats Rasterize;
+        SampleStats Test;
+        // per frame, averaged
+        double InFrustum;
+        double Occluded;
+    };
+
+    // a box right behind a wall must be occluded, one in front of it or above it must not, nor
+    // one sticking out of the wall by less than a pixel in a row whose center the wall covers
+    inline bool SelfTest()
+    {
+        WorkerPool pool;
+        OcclusionBuffer buffer;
+        buffer.AddBox(glm::vec3(-5.0f, 0.0f, -0.2f), glm::vec3(5.0f, 4.0f, 0.2f));
+        glm::mat4 viewProjection = glm::perspective(glm::radians(90.0f), 2.0f, 0.1f, 100.0f) *
+                                   glm::lookAt(glm::vec3(0.0f, 2.0f, 10.0f), glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        buffer.Render(viewProjection, pool);
+        bool behind = buffer.IsOccluded(BoundingBox(glm::vec3(-0.5f, 0.0f, -3.0f), glm::vec3(0.5f, 2.0f, -2.0f)));
+        bool front = buffer.IsOccluded(BoundingBox(glm::vec3(-0.5f, 0.0f, 2.0f), glm::vec3(0.5f, 2.0f, 3.0f)));
+        bool above = buffer.IsOccluded(BoundingBox(glm::vec3(-0.5f, 3.0f, -3.0f), glm::vec3(0.5f, 6.0f, -2.0f)));
+
+        // the camera looks along -z from y = 2 with a 90 degree view 128 pixels high, so a height h
+        // at distance d lands on row (1 + (h - 2) / d) * 64. The wall's top edge crosses row 77 at
+        // 77.8, above its center, and the box's top reaches 77.9 from 12 units away.
+        OcclusionBuffer edge;
+        edge.AddBox(glm::vec3(-5.0f, 0.0f, -0.2f), glm::vec3(5.0f, 2.0f + (77.8f / 64.0f - 1.0f) * 9.8f, 0.2f));
+        edge.Render(viewProjection, pool);
+        bool edgePixel = edge.IsOccluded(BoundingBox(glm::vec3(-0.5f, 0.0f, -3.0f), glm::vec3(0.5f, 2.0f + (77.9f / 64.0f - 1.0f) * 12.0f, -2.0f)));
+        if (!behind || front || above || edgePixel)
+        {
+            std::cout << "ERROR::OCCLUSION_BENCH: Self test failed (behind " << behind << ", front " << front << ", above " << above
+                      << ", edge pixel " << edgePixel << ")" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // box is the bind pose box of the character, spacing the distance between two of them
+    inline Result Run(const BoundingBox& box, unsigned int instances, unsigned int walls, float spacing, unsigned int threads,
+                      unsigned int warmup, unsigned int repetitions)
+    {
+        Result result;
+        result.Instances = instances;
+        result.Walls = walls;
+        result.InFrustum = result.Occluded = 0.0;
+
+        unsigned int side = (unsigned int)std::ceil(std::sqrt((float)instances));
+        float extent = side * spacing;
+        std::vector<BoundingBox> boxes(instances);
+        for (unsigned int i = 0; i < instances; i++)
+        {
+            glm::vec3 offset((i % side + 0.5f) * spacing - extent * 0.5f, 0.0f, (i / side + 0.5f) * spacing - extent * 0.5f);
+            boxes[i] = BoundingBox(box.Min + offset, box.Max + offset);
+        }
+
+        float height = box.Max.y - box.Min.y;
+        WorkerPool pool(threads > 1 ? threads - 1 : 0);
+        OcclusionBuffer buffer;
+        std::vector<BoundingBox> wallBoxes = Occlusion::ScatterWalls(walls, extent, spacing, height * 1.5f, 1);
+        for (unsigned int w = 0; w < wallBoxes.size(); w++)
+            buffer.AddBox(wallBoxes[w].Min, wallBoxes[w].Max);
+
+        std::vector<double> rasterizeSamples, testSamples;
+        uint64_t inFrustum = 0, occluded = 0;
+        for (unsigned int r = 0; r < warmup + repetitions; r++)
+        {
+            float angle = 2.0f * glm::pi<float>() * r / (warmup + repetitions);
+            glm::vec3 eye(std::sin(angle) * extent * 0.6f, height * 0.9f, std::cos(angle) * extent * 0.6f);
+            glm::mat4 viewProjection = glm::perspective(glm::radians(90.0f), 16.0f / 9.0f, 0.1f, extent * 2.0f + 20.0f) *
+                                       glm::lookAt(eye, glm::vec3(0.0f, height * 0.5f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            Frustum frustum(viewProjection);
+
+            Timer rasterizeTimer;
+            buffer.Render(viewProjection, pool);
+            double rasterize = rasterizeTimer.ElapsedMilliseconds();
+
+            Timer testTimer;
+            unsigned int frameInFrustum = 0, frameOccluded = 0;
+            for (unsigned int i = 0; i < instances; i++)
+            {
+                if (!frustum.Intersects(boxes[i]))
+                    continue;
+                frameInFrustum++;
+                frameOccluded += buffer.IsOccluded(boxes[i]) ? 1 : 0;
+            }
+            double test = testTimer.ElapsedMilliseconds();
+
+            if (r < warmup)
+                continue;
+            rasterizeSamples.push_back(rasterize);
+            testSamples.push_back(test);
+            inFrustum += frameInFrustum;
+            occluded += frameOccluded;
+        }
+        result.Rasterize = SampleStats::Compute(rasterizeSamples);
+        result.Test = SampleStats::Compute(testSamples);
+        result.InFrustum = repetitions > 0 ? (double)inFrustum / repetitions : 0.0;
+        result.Occluded = repetitions > 0 ? (double)occluded / repetitions : 0.0;
+        return result;
+    }
+
+    inline void Print(std::ostream& out, const Result& result)
+    {
+        out << result.Instances << " instances, " << result.Walls << " walls: rasterize " << result.Rasterize.P50 << " ms (p90 "
+            << result.Rasterize.P90 << "), test " << result.Test.P50 << " ms (p90 " << result.Test.P90 << "), "
+            << result.InFrustum << " in view, " << result.Occluded << " occluded ("
+            << (result.InFrustum > 0.0 ? 100.0 * result.Occluded / result.InFrustum : 0.0) << "%)" << std::endl;
+    }
+}
+
+#endif
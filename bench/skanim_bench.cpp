@@ -0,0 +1,556 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "batch_import.hpp"
+#include "golden.hpp"
+#include "import_report.hpp"
+#include "model_loader.hpp"
+#include "occlusion_bench.hpp"
+#include "timing.hpp"
+
+// Animation microbenchmark: imports the characters without a window or GL context and times
+// the three stages of pose evaluation (sampling, hierarchy, palette) for growing crowds.
+// With --verify it also compares every clip against the golden poses and fails when a stage
+// goes over its time budget, so correctness and speed are checked by the same run.
+// With --import-dir it measures import throughput over a directory of assets instead, and
+// with --occlusion the software occlusion culling of a crowd among walls.
+
+// upper bound for the median time a stage may take per instance
+struct StageBudget
+{
+    std::string Asset; // empty applies to every asset
+    std::string Stage;
+    double MaxNanoseconds;
+};
+
+struct BenchOptions
+{
+    std::string AssetsDirectory;
+    std::vector<std::string> Assets;
+    std::vector<unsigned int> InstanceCounts;
+    unsigned int WarmupRepetitions;
+    unsigned int Repetitions;
+    std::string CsvPath;
+    std::string JsonPath;
+    // regression mode
+    bool Verify;
+    bool UpdateGolden;
+    // an asset without golden poses is reported instead of failing the run
+    bool AllowMissingGolden;
+    std::string GoldenDirectory;
+    float Tolerance;
+    std::vector<StageBudget> Budgets;
+    // per-stage import timings of every asset
+    bool PrintImportReport;
+    std::string ImportJsonPath;
+    // batch import mode
+    std::string ImportDirectory;
+    unsigned int Threads;
+    unsigned int Slowest;
+    // occlusion mode, walls scattered over the crowd
+    unsigned int OcclusionWalls;
+
+    BenchOptions() : AssetsDirectory(PROJECT_SOURCE_DIR "/assets"), WarmupRepetitions(5), Repetitions(50),
+        Verify(false), UpdateGolden(false), AllowMissingGolden(false), GoldenDirectory(PROJECT_SOURCE_DIR "/bench/golden"), Tolerance(1e-4f),
+        PrintImportReport(false), Threads(std::max(1u, std::thread::hardware_concurrency())), Slowest(5), OcclusionWalls(0)
+    {
+        Assets.push_back("man");
+        Assets.push_back("woman");
+        Assets.push_back("zombie");
+        InstanceCounts.push_back(1);
+        InstanceCounts.push_back(100);
+        InstanceCounts.push_back(1000);
+        InstanceCounts.push_back(10000);
+    }
+};
+
+struct BenchResult
+{
+    std::string Asset;
+    unsigned int Instances;
+    std::string Stage;
+    // milliseconds to run the stage for all the instances, one sample per repetition
+    SampleStats Stats;
+};
+
+struct BenchInstance
+{
+    unsigned int Clip;
+    float TimeOffset;
+    Pose InstancePose;
+};
+
+static bool ParseArguments(int argc, char** argv, BenchOptions& options);
+static void PrintUsage();
+static void RunAsset(const std::string& name, const Model& model, const BenchOptions& options, std::vector<BenchResult>& results);
+static void WriteCsv(const std::string& path, const std::vector<BenchResult>& results);
+static void WriteJson(const std::string& path, const std::vector<BenchResult>& results);
+static int RunBatchImport(const BenchOptions& options);
+static int RunOcclusion(const BenchOptions& options);
+static bool ParseBudget(const std::string& text, StageBudget& budget);
+static bool LoadBudgets(const std::string& path, std::vector<StageBudget>& budgets);
+static bool CheckBudgets(const std::vector<BenchResult>& results, const std::vector<StageBudget>& budgets);
+
+// keeps the optimizer from discarding the evaluated palettes
+static float checksum = 0.0f;
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    if (!ParseArguments(argc, argv, options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    if (!options.ImportDirectory.empty())
+        return RunBatchImport(options);
+    if (options.OcclusionWalls > 0)
+        return RunOcclusion(options);
+
+    // budgets recorded next to the goldens, unless given on the command line
+    if (options.Verify && options.Budgets.empty() && !LoadBudgets(options.GoldenDirectory + "/budgets.txt", options.Budgets))
+        return 1;
+
+    bool passed = true;
+    unsigned int missingGoldens = 0;
+    std::vector<BenchResult> results;
+    std::vector<ImportReport> importReports(options.Assets.size());
+    for (unsigned int i = 0; i < options.Assets.size(); i++)
+    {
+        ModelLoadOptions loadOptions;
+        loadOptions.UploadToGPU = false;
+        loadOptions.Residency = ResidencyPolicy::ReleaseAfterUpload;
+        if (options.PrintImportReport || !options.ImportJsonPath.empty())
+            loadOptions.Report = &importReports[i];
+        Model model = LoadModelFromFilename(options.AssetsDirectory + "/" + options.Assets[i] + ".fbx", loadOptions);
+        if (options.PrintImportReport)
+            importReports[i].Print(std::cout);
+        if (!model.HasAnimations())
+        {
+            std::cout << "Skipping " << options.Assets[i] << ": no animations" << std::endl;
+            passed = passed && !options.Verify;
+            continue;
+        }
+
+        std::string goldenPath = options.GoldenDirectory + "/" + options.Assets[i] + ".pose";
+        if (options.UpdateGolden)
+        {
+            if (Golden::Write(goldenPath, Golden::SamplePoses(model)))
+                std::cout << "Updated " << goldenPath << std::endl;
+            else
+                passed = false;
+        }
+        else if (options.Verify && !Golden::Exists(goldenPath))
+        {
+            std::cout << (options.AllowMissingGolden ? "SKIP " : "FAIL ") << options.Assets[i] << ": no golden poses at " << goldenPath
+                      << " (record them with --update-golden)" << std::endl;
+            missingGoldens++;
+            passed = passed && options.AllowMissingGolden;
+        }
+        else if (options.Verify)
+            passed = Golden::Verify(options.Assets[i], goldenPath, model, options.Tolerance) && passed;
+
+        RunAsset(options.Assets[i], model, options, results);
+    }
+
+    if (!options.CsvPath.empty())
+        WriteCsv(options.CsvPath, results);
+    if (!options.JsonPath.empty())
+        WriteJson(options.JsonPath, results);
+    if (!options.ImportJsonPath.empty())
+        ImportReport::WriteJson(options.ImportJsonPath, importReports);
+
+    if (options.Verify)
+        passed = CheckBudgets(results, options.Budgets) && passed;
+
+    std::cout << "checksum " << checksum << std::endl;
+    if (options.Verify)
+    {
+        std::cout << (passed ? "All checks passed" : "Some checks FAILED");
+        if (missingGoldens > 0)
+            std::cout << ", " << missingGoldens << " asset(s) without golden poses";
+        std::cout << std::endl;
+    }
+    return passed ? 0 : 1;
+}
+
+static std::vector<std::string> SplitList(const std::string& list)
+{
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ','))
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+// a whole number greater than zero, or zero when allowed
+static bool ParseCount(const std::string& text, unsigned int& count, bool allowZero = false)
+{
+    char* end = nullptr;
+    unsigned long value = std::strtoul(text.c_str(), &end, 10);
+    if (end == text.c_str() || *end != '\0' || text[0] == '-' || (value == 0 && !allowZero) || value > 0xFFFFFFFFul)
+        return false;
+    count = (unsigned int)value;
+    return true;
+}
+
+// the count given to a flag, reported when it doesn't parse
+static bool ParseFlagCount(const std::string& flag, const std::string& text, unsigned int& count, bool allowZero = false)
+{
+    if (ParseCount(text, count, allowZero))
+        return true;
+    std::cout << "ERROR::BENCH: Invalid count '" << text << "' for " << flag << std::endl;
+    return false;
+}
+
+static bool ParseArguments(int argc, char** argv, BenchOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+        if (arg == "--verify")
+        {
+            options.Verify = true;
+            continue;
+        }
+        if (arg == "--update-golden")
+        {
+            options.UpdateGolden = true;
+            continue;
+        }
+        if (arg == "--allow-missing-golden")
+        {
+            options.AllowMissingGolden = true;
+            continue;
+        }
+        if (arg == "--import-report")
+        {
+            options.PrintImportReport = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+            return false;
+        std::string value(argv[++i]);
+
+        if (arg == "--assets-dir")
+            options.AssetsDirectory = value;
+        else if (arg == "--assets")
+            options.Assets = SplitList(value);
+        else if (arg == "--instances")
+        {
+            options.InstanceCounts.clear();
+            std::vector<std::string> counts = SplitList(value);
+            for (unsigned int c = 0; c < counts.size(); c++)
+            {
+                unsigned int count;
+                if (!ParseCount(counts[c], count))
+                {
+                    std::cout << "ERROR::BENCH: Invalid instance count '" << counts[c] << "'" << std::endl;
+                    return false;
+                }
+                options.InstanceCounts.push_back(count);
+            }
+            if (options.InstanceCounts.empty())
+                return false;
+        }
+        else if (arg == "--warmup")
+        {
+            if (!ParseFlagCount(arg, value, options.WarmupRepetitions, true))
+                return false;
+        }
+        else if (arg == "--reps")
+        {
+            if (!ParseFlagCount(arg, value, options.Repetitions))
+                return false;
+        }
+        else if (arg == "--csv")
+            options.CsvPath = value;
+        else if (arg == "--json")
+            options.JsonPath = value;
+        else if (arg == "--import-json")
+            options.ImportJsonPath = value;
+        else if (arg == "--import-dir")
+            options.ImportDirectory = value;
+        else if (arg == "--threads")
+        {
+            if (!ParseFlagCount(arg, value, options.Threads))
+                return false;
+        }
+        else if (arg == "--occlusion")
+        {
+            if (!ParseFlagCount(arg, value, options.OcclusionWalls))
+                return false;
+        }
+        else if (arg == "--slowest")
+        {
+            if (!ParseFlagCount(arg, value, options.Slowest))
+                return false;
+        }
+        else if (arg == "--golden-dir")
+            options.GoldenDirectory = value;
+        else if (arg == "--tolerance")
+            options.Tolerance = (float)std::atof(value.c_str());
+        else if (arg == "--budget")
+        {
+            StageBudget budget;
+            if (!ParseBudget(value, budget))
+                return false;
+            options.Budgets.push_back(budget);
+        }
+        else if (arg == "--budgets")
+        {
+            if (!LoadBudgets(value, options.Budgets))
+                return false;
+        }
+        else
+            return false;
+    }
+    return true;
+}
+
+static void PrintUsage()
+{
+    std::cout << "usage: skanim_bench [--assets-dir DIR] [--assets man,woman,zombie] [--instances 1,100,1000,10000]\n"
+              << "                    [--warmup N] [--reps N] [--csv FILE] [--json FILE]\n"
+              << "                    [--verify] [--allow-missing-golden] [--update-golden] [--golden-dir DIR] [--tolerance T]\n"
+              << "                    [--budget [ASSET.]STAGE=NS] [--budgets FILE] [--import-report] [--import-json FILE]\n"
+              << "       skanim_bench --import-dir DIR [--threads N] [--slowest N] [--import-json FILE]\n"
+              << "       skanim_bench --occlusion WALLS [--assets man] [--instances 1000,10000] [--threads N] [--warmup N] [--reps N]\n"
+              << "budgets limit the median nanoseconds per instance of a stage (sampling, hierarchy, palette)" << std::endl;
+}
+
+static void RunAsset(const std::string& name, const Model& model, const BenchOptions& options, std::vector<BenchResult>& results)
+{
+    const Skeleton& skeleton = model.GetSkeleton();
+    std::cout << name << ": " << skeleton.Joints.size() << " joints, " << skeleton.GetNumBones() << " bones, "
+              << model.GetNumAnimations() << " clips" << std::endl;
+
+    for (unsigned int c = 0; c < options.InstanceCounts.size(); c++)
+    {
+        unsigned int count = options.InstanceCounts[c];
+
+        // every instance plays one of the clips with its own phase, as a crowd would
+        std::vector<BenchInstance> instances(count);
+        unsigned int seed = 12345;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            instances[i].Clip = i % model.GetNumAnimations();
+            instances[i].TimeOffset = (float)(seed >> 8) / (float)(1 << 24) * 10.0f;
+            instances[i].InstancePose.Resize(skeleton);
+        }
+
+        std::vector<double> sampling, hierarchy, palette;
+        for (unsigned int rep = 0; rep < options.WarmupRepetitions + options.Repetitions; rep++)
+        {
+            float time = rep / 60.0f;
+            Timer timer;
+
+            for (unsigned int i = 0; i < count; i++)
+            {
+                const AnimationClip& clip = model.GetAnimation(instances[i].Clip);
+                Animation::SampleLocalPose(skeleton, clip, Animation::ClipTime(clip, time + instances[i].TimeOffset), instances[i].InstancePose.Local);
+            }
+            double samplingTime = timer.ElapsedMilliseconds();
+
+            timer.Reset();
+            for (unsigned int i = 0; i < count; i++)
+                Animation::EvaluateHierarchy(skeleton, instances[i].InstancePose.Local, instances[i].InstancePose.Global);
+            double hierarchyTime = timer.ElapsedMilliseconds();
+
+            timer.Reset();
+            for (unsigned int i = 0; i < count; i++)
+                Animation::BuildPalette(skeleton, instances[i].InstancePose.Global, instances[i].InstancePose.Palette);
+            double paletteTime = timer.ElapsedMilliseconds();
+
+            if (skeleton.GetNumBones() > 0)
+                checksum += instances[rep % count].InstancePose.Palette[0][3][0];
+
+            if (rep < options.WarmupRepetitions)
+                continue;
+            sampling.push_back(samplingTime);
+            hierarchy.push_back(hierarchyTime);
+            palette.push_back(paletteTime);
+        }
+
+        const char* stages[] = { "sampling", "hierarchy", "palette" };
+        std::vector<double>* samples[] = { &sampling, &hierarchy, &palette };
+        for (unsigned int s = 0; s < 3; s++)
+        {
+            BenchResult result;
+            result.Asset = name;
+            result.Instances = count;
+            result.Stage = stages[s];
+            result.Stats = SampleStats::Compute(*samples[s]);
+            results.push_back(result);
+
+            std::cout << "  " << count << " instances, " << stages[s] << ": mean " << result.Stats.Mean << " ms, p50 "
+                      << result.Stats.P50 << " ms, p99 " << result.Stats.P99 << " ms ("
+                      << result.Stats.Mean * 1.0e6 / count << " ns/instance)" << std::endl;
+        }
+    }
+}
+
+static void WriteCsv(const std::string& path, const std::vector<BenchResult>& results)
+{
+    std::ofstream file(path.c_str());
+    if (!file)
+    {
+        std::cout << "ERROR::BENCH: Failed to write " << path << std::endl;
+        return;
+    }
+    file << "asset,instances,stage,reps,min_ms,mean_ms,p50_ms,p90_ms,p99_ms,max_ms,ns_per_instance\n";
+    for (unsigned int i = 0; i < results.size(); i++)
+    {
+        const BenchResult& r = results[i];
+        file << r.Asset << ',' << r.Instances << ',' << r.Stage << ',' << r.Stats.Count << ','
+             << r.Stats.Min << ',' << r.Stats.Mean << ',' << r.Stats.P50 << ',' << r.Stats.P90 << ','
+             << r.Stats.P99 << ',' << r.Stats.Max << ',' << r.Stats.Mean * 1.0e6 / r.Instances << '\n';
+    }
+}
+
+static void WriteJson(const std::string& path, const std::vector<BenchResult>& results)
+{
+    std::ofstream file(path.c_str());
+    if (!file)
+    {
+        std::cout << "ERROR::BENCH: Failed to write " << path << std::endl;
+        return;
+    }
+    file << "[\n";
+    for (unsigned int i = 0; i < results.size(); i++)
+    {
+        const BenchResult& r = results[i];
+        file << "  { \"asset\": \"" << r.Asset << "\", \"instances\": " << r.Instances << ", \"stage\": \"" << r.Stage
+             << "\", \"reps\": " << r.Stats.Count << ", \"min_ms\": " << r.Stats.Min << ", \"mean_ms\": " << r.Stats.Mean
+             << ", \"p50_ms\": " << r.Stats.P50 << ", \"p90_ms\": " << r.Stats.P90 << ", \"p99_ms\": " << r.Stats.P99
+             << ", \"max_ms\": " << r.Stats.Max << ", \"ns_per_instance\": " << r.Stats.Mean * 1.0e6 / r.Instances << " }"
+             << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    file << "]\n";
+}
+
+// imports every FBX file under the directory and reports the throughput
+static int RunBatchImport(const BenchOptions& options)
+{
+    std::vector<std::string> files;
+    BatchImport::FindFiles(options.ImportDirectory, ".fbx", files);
+    if (files.empty())
+    {
+        std::cout << "ERROR::BENCH: No .fbx file found under " << options.ImportDirectory << std::endl;
+        return 1;
+    }
+    // the same order on every run, whatever the file system returns
+    std::sort(files.begin(), files.end());
+
+    std::vector<ImportReport> reports;
+    double milliseconds = BatchImport::Run(files, options.Threads, reports);
+    BatchImport::PrintSummary(std::cout, reports, options.Threads, milliseconds, options.Slowest);
+    if (!options.ImportJsonPath.empty())
+        ImportReport::WriteJson(options.ImportJsonPath, reports);
+    for (unsigned int i = 0; i < reports.size(); i++)
+        if (!reports[i].Imported)
+            return 1;
+    return 0;
+}
+
+// the crowd is made of boxes around the bind pose of the first asset
+static int RunOcclusion(const BenchOptions& options)
+{
+    if (!OcclusionBench::SelfTest() || options.Assets.empty())
+        return 1;
+    ModelLoadOptions loadOptions;
+    loadOptions.UploadToGPU = false;
+    loadOptions.Residency = ResidencyPolicy::ReleaseAfterUpload;
+    Model model = LoadModelFromFilename(options.AssetsDirectory + "/" + options.Assets[0] + ".fbx", loadOptions);
+    BoundingBox box(model.GetBoundsMin(), model.GetBoundsMax());
+    if (box.IsEmpty())
+    {
+        std::cout << "ERROR::BENCH: " << options.Assets[0] << " has no vertices" << std::endl;
+        return 1;
+    }
+    // the spacing of the stress scene
+    float spacing = std::max(4.0f, (box.Max.x - box.Min.x) * 1.5f);
+    for (unsigned int c = 0; c < options.InstanceCounts.size(); c++)
+    {
+        OcclusionBench::Result result = OcclusionBench::Run(box, options.InstanceCounts[c], options.OcclusionWalls, spacing,
+                                                            options.Threads, options.WarmupRepetitions, options.Repetitions);
+        OcclusionBench::Print(std::cout, result);
+    }
+    return 0;
+}
+
+// "stage=ns" or "asset.stage=ns"
+static bool ParseBudget(const std::string& text, StageBudget& budget)
+{
+    size_t equals = text.find('=');
+    if (equals == std::string::npos)
+        return false;
+    std::string key = text.substr(0, equals);
+    size_t dot = key.find('.');
+    budget.Asset = dot != std::string::npos ? key.substr(0, dot) : "";
+    budget.Stage = dot != std::string::npos ? key.substr(dot + 1) : key;
+    budget.MaxNanoseconds = std::atof(text.c_str() + equals + 1);
+    return !budget.Stage.empty() && budget.MaxNanoseconds > 0.0;
+}
+
+// one budget per line, '#' starts a comment
+static bool LoadBudgets(const std::string& path, std::vector<StageBudget>& budgets)
+{
+    std::ifstream file(path.c_str());
+    if (!file)
+    {
+        std::cout << "ERROR::BENCH: Failed to read " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line))
+    {
+        line = line.substr(0, line.find('#'));
+        std::stringstream stream(line);
+        std::string entry;
+        if (!(stream >> entry))
+            continue;
+        StageBudget budget;
+        if (!ParseBudget(entry, budget))
+        {
+            std::cout << "ERROR::BENCH: Invalid budget '" << entry << "' in " << path << std::endl;
+            return false;
+        }
+        budgets.push_back(budget);
+    }
+    return true;
+}
+
+static bool CheckBudgets(const std::vector<BenchResult>& results, const std::vector<StageBudget>& budgets)
+{
+    bool passed = true;
+    for (unsigned int b = 0; b < budgets.size(); b++)
+    {
+        for (unsigned int r = 0; r < results.size(); r++)
+        {
+            const BenchResult& result = results[r];
+            if (result.Stage != budgets[b].Stage || (!budgets[b].Asset.empty() && result.Asset != budgets[b].Asset))
+                continue;
+            double nanoseconds = result.Stats.P50 * 1.0e6 / result.Instances;
+            if (nanoseconds > budgets[b].MaxNanoseconds)
+            {
+                std::cout << "FAIL budget " << result.Asset << "." << result.Stage << " with " << result.Instances << " instances: "
+                          << nanoseconds << " ns/instance > " << budgets[b].MaxNanoseconds << " ns" << std::endl;
+                passed = false;
+            }
+        }
+    }
+    return passed;
+}
@@ -0,0 +1,108 @@
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// Heap allocation counting for the frame loop. Building with SKANIM_TRACK_ALLOCATIONS replaces
+// the global new/delete with counting versions; without it every count stays at zero.
+// Like the stb implementations, the replacements live in this header: include it from one
+// translation unit per executable.
+
+namespace AllocTracker
+{
+    inline std::atomic<size_t>& allocationCounter()
+    {
+        static std::atomic<size_t> counter(0);
+        return counter;
+    }
+
+    inline std::atomic<size_t>& byteCounter()
+    {
+        static std::atomic<size_t> counter(0);
+        return counter;
+    }
+
+    inline bool IsEnabled()
+    {
+#ifdef SKANIM_TRACK_ALLOCATIONS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // total number of operator new calls since startup
+    inline size_t GetAllocationCount() { return allocationCounter().load(std::memory_order_relaxed); }
+    inline size_t GetAllocatedBytes() { return byteCounter().load(std::memory_order_relaxed); }
+
+    inline void* allocate(size_t size)
+    {
+        allocationCounter().fetch_add(1, std::memory_order_relaxed);
+        byteCounter().fetch_add(size, std::memory_order_relaxed);
+        void* pointer = std::malloc(size > 0 ? size : 1);
+        if (!pointer)
+            throw std::bad_alloc();
+        return pointer;
+    }
+}
+
+#ifdef SKANIM_TRACK_ALLOCATIONS
+void* operator new(size_t size) { return AllocTracker::allocate(size); }
+void* operator new[](size_t size) { return AllocTracker::allocate(size); }
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+#endif
+
+// Counts the allocations made between BeginFrame and EndFrame. Once the warm-up frames are over
+// (buffers grown to their final size, caches filled) a steady-state frame must not allocate at all.
+class FrameAllocations
+{
+    public:
+        FrameAllocations(unsigned int warmupFrames = 10) :
+            warmupFrames(warmupFrames), frame(0), frameStart(0), lastFrame(0),
+            steadyStateAllocations(0), allocatingFrames(0) {}
+
+        void BeginFrame()
+        {
+            frameStart = AllocTracker::GetAllocationCount();
+        }
+
+        void EndFrame()
+        {
+            lastFrame = AllocTracker::GetAllocationCount() - frameStart;
+            if (frame >= warmupFrames && lastFrame > 0)
+            {
+                if (allocatingFrames == 0)
+                    std::cout << "ERROR::ALLOCATIONS: frame " << frame << " made " << lastFrame << " heap allocations" << std::endl;
+                steadyStateAllocations += lastFrame;
+                allocatingFrames++;
+            }
+            frame++;
+        }
+
+        size_t GetLastFrameAllocations() const { return lastFrame; }
+        size_t GetSteadyStateAllocations() const { return steadyStateAllocations; }
+        bool Failed() const { return steadyStateAllocations > 0; }
+
+        void Report(std::ostream& out) const
+        {
+            if (!AllocTracker::IsEnabled())
+                return;
+            out << "Allocations: " << steadyStateAllocations << " in " << allocatingFrames << " of "
+                << (frame > warmupFrames ? frame - warmupFrames : 0) << " steady-state frames" << std::endl;
+        }
+
+    private:
+        unsigned int warmupFrames;
+        unsigned int frame;
+        size_t frameStart;
+        size_t lastFrame;
+        size_t steadyStateAllocations;
+        unsigned int allocatingFrames;
+};
+
+#endif
@@ -0,0 +1,376 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include "frame_stats.hpp"
+#include "profiler.hpp"
+
+// Skeleton and keyframe data extracted from the imported scene, so the model doesn't need
+// to keep ASSIMP's scene around, plus the three stages of pose evaluation:
+// sampling the clip into local transforms, walking the hierarchy, building the bone palette.
+
+struct VectorKey
+{
+    float Time;
+    glm::vec3 Value;
+};
+
+struct QuatKey
+{
+    float Time;
+    glm::quat Value;
+};
+
+// keyframes animating a single joint
+struct AnimationChannel
+{
+    unsigned int Joint;
+    std::vector<VectorKey> PositionKeys;
+    std::vector<QuatKey> RotationKeys;
+    std::vector<VectorKey> ScalingKeys;
+
+    size_t GetCPUBytes() const
+    {
+        return sizeof(AnimationChannel) + PositionKeys.capacity() * sizeof(VectorKey)
+            + RotationKeys.capacity() * sizeof(QuatKey) + ScalingKeys.capacity() * sizeof(VectorKey);
+    }
+};
+
+struct AnimationClip
+{
+    std::string Name;
+    // duration of the animation in ticks, can be changed if frames are not present in all interval
+    float Duration;
+    float TicksPerSecond;
+    std::vector<AnimationChannel> Channels;
+
+    AnimationClip() : Duration(0.0f), TicksPerSecond(25.0f) {}
+
+    size_t GetCPUBytes() const
+    {
+        size_t bytes = sizeof(AnimationClip) + Name.capacity();
+        for (unsigned int i = 0; i < Channels.size(); i++)
+            bytes += Channels[i].GetCPUBytes();
+        return bytes;
+    }
+};
+
+struct Joint
+{
+    std::string Name;
+    // index of the parent joint, -1 for the root. Parents always come before their children.
+    int Parent;
+    // index in the bone palette, -1 if no vertex is skinned to this joint
+    int Bone;
+    // bind transformation relative to the parent, used when the clip doesn't animate the joint
+    glm::mat4 LocalTransform;
+};
+
+// number of skeleton LOD levels built at import, and the smallest subtree a level keeps,
+// as a fraction of the size of the model
+const unsigned int SKELETON_LOD_LEVELS = 4;
+const float SKELETON_LOD_MIN_EXTENT[SKELETON_LOD_LEVELS] = { 0.0f, 0.05f, 0.12f, 0.25f };
+
+// Joints evaluated at one level of detail. A joint is pruned with its whole subtree when the
+// skin it moves is small (fingers, face). The bones of pruned joints follow their closest
+// kept ancestor rigidly, in their rest pose relative to it.
+struct SkeletonLod
+{
+    // kept joints, parents before children
+    std::vector<unsigned int> Joints;
+    // 1 for the kept joints, indexed by joint
+    std::vector<unsigned char> Keep;
+
+    struct PrunedBone
+    {
+        unsigned int Bone;
+        unsigned int Ancestor;
+        // rest transform from the ancestor to the joint, times the bone offset
+        glm::mat4 Offset;
+    };
+    std::vector<PrunedBone> PrunedBones;
+
+    size_t GetCPUBytes() const
+    {
+        return sizeof(SkeletonLod) + Joints.capacity() * sizeof(unsigned int) + Keep.capacity() + PrunedBones.capacity() * sizeof(PrunedBone);
+    }
+};
+
+struct Skeleton
+{
+    std::vector<Joint> Joints;
+    // bind pose (model space) to bone space, indexed by bone
+    std::vector<glm::mat4> BoneOffsets;
+    // box around the vertices each bone moves, in bind pose model space, indexed by bone
+    std::vector<glm::vec3> BoneBoundsMin;
+    std::vector<glm::vec3> BoneBoundsMax;
+    glm::mat4 GlobalInverseTransform;
+    // level 0 keeps every joint, see SKELETON_LOD_MIN_EXTENT
+    std::vector<SkeletonLod> Lods;
+
+    unsigned int GetNumBones() const { return (unsigned int)BoneOffsets.size(); }
+
+    size_t GetCPUBytes() const
+    {
+        size_t bytes = sizeof(Skeleton) + Joints.capacity() * sizeof(Joint) + BoneOffsets.capacity() * sizeof(glm::mat4)
+            + (BoneBoundsMin.capacity() + BoneBoundsMax.capacity()) * sizeof(glm::vec3);
+        for (unsigned int i = 0; i < Joints.size(); i++)
+            bytes += Joints[i].Name.capacity();
+        for (unsigned int i = 0; i < Lods.size(); i++)
+            bytes += Lods[i].GetCPUBytes();
+        return bytes;
+    }
+};
+
+// Scratch buffers of one evaluated pose
+struct Pose
+{
+    std::vector<glm::mat4> Local;
+    std::vector<glm::mat4> Global;
+    std::vector<glm::mat4> Palette;
+
+    void Resize(const Skeleton& skeleton)
+    {
+        Local.resize(skeleton.Joints.size());
+        Global.resize(skeleton.Joints.size());
+        Palette.resize(skeleton.GetNumBones());
+    }
+};
+
+namespace Animation
+{
+    // index of the key starting the interval that contains animationTime, adds the keys visited to steps
+    template <typename Key>
+    inline unsigned int findKey(float animationTime, const std::vector<Key>& keys, unsigned int& steps)
+    {
+        for (unsigned int i = 0 ; i < keys.size() - 1 ; i++)
+        {
+            if (animationTime < keys[i + 1].Time)
+            {
+                steps += i + 1;
+                return i;
+            }
+        }
+
+        steps += (unsigned int)keys.size() - 1;
+        return (unsigned int)keys.size() - 2;
+    }
+
+    template <typename Key>
+    inline float keyFactor(float animationTime, const std::vector<Key>& keys, unsigned int index)
+    {
+        float deltaTime = keys[index + 1].Time - keys[index].Time;
+        float factor = (animationTime - keys[index].Time) / deltaTime;
+        return glm::clamp(factor, 0.0f, 1.0f);
+    }
+
+    inline glm::vec3 calcInterpolatedVector(float animationTime, const std::vector<VectorKey>& keys, unsigned int& steps)
+    {
+        // we need at least two values to interpolate...
+        if (keys.size() == 1)
+            return keys[0].Value;
+
+        unsigned int index = findKey(animationTime, keys, steps);
+        float factor = keyFactor(animationTime, keys, index);
+        return keys[index].Value + factor * (keys[index + 1].Value - keys[index].Value);
+    }
+
+    inline glm::quat calcInterpolatedRotation(float animationTime, const std::vector<QuatKey>& keys, unsigned int& steps)
+    {
+        if (keys.size() == 1)
+            return keys[0].Value;
+
+        unsigned int index = findKey(animationTime, keys, steps);
+        float factor = keyFactor(animationTime, keys, index);
+        return glm::normalize(glm::slerp(keys[index].Value, keys[index + 1].Value, factor));
+    }
+
+    // converts seconds into the clip's ticks, wrapped to loop the animation
+    inline float ClipTime(const AnimationClip& clip, float timeInSeconds)
+    {
+        float timeInTicks = timeInSeconds * clip.TicksPerSecond;
+        return clip.Duration > 0.0f ? std::fmod(timeInTicks, clip.Duration) : 0.0f;
+    }
+
+    // stage 1: local transformation of every joint at animationTime (in ticks)
+    inline void SampleLocalPose(const Skeleton& skeleton, const AnimationClip& clip, float animationTime, std::vector<glm::mat4>& local)
+    {
+        PROFILE_SCOPE("SampleLocalPose");
+        for (unsigned int i = 0; i < skeleton.Joints.size(); i++)
+            local[i] = skeleton.Joints[i].LocalTransform;
+
+        unsigned int searchSteps = 0;
+        for (unsigned int i = 0; i < clip.Channels.size(); i++)
+        {
+            const AnimationChannel& channel = clip.Channels[i];
+            // Interpolate scaling, rotation and translation and combine them
+            glm::vec3 scale = calcInterpolatedVector(animationTime, channel.ScalingKeys, searchSteps);
+            glm::quat rotate = calcInterpolatedRotation(animationTime, channel.RotationKeys, searchSteps);
+            glm::vec3 translate = calcInterpolatedVector(animationTime, channel.PositionKeys, searchSteps);
+            local[channel.Joint] = glm::translate(glm::mat4(1.0f), translate) * glm::toMat4(rotate) * glm::scale(glm::mat4(1.0f), scale);
+        }
+        FRAME_STAT_ADD(COUNTER_CHANNELS_SAMPLED, clip.Channels.size());
+        FRAME_STAT_ADD(COUNTER_KEY_SEARCH_STEPS, searchSteps);
+    }
+
+    // stage 2: combine every joint with its parent's transformation
+    inline void EvaluateHierarchy(const Skeleton& skeleton, const std::vector<glm::mat4>& local, std::vector<glm::mat4>& global)
+    {
+        PROFILE_SCOPE("EvaluateHierarchy");
+        for (unsigned int i = 0; i < skeleton.Joints.size(); i++)
+        {
+            int parent = skeleton.Joints[i].Parent;
+            global[i] = parent >= 0 ? global[parent] * local[i] : local[i];
+        }
+    }
+
+    // stage 3: final skinning matrices uploaded to the shader
+    inline void BuildPalette(const Skeleton& skeleton, const std::vector<glm::mat4>& global, std::vector<glm::mat4>& palette)
+    {
+        PROFILE_SCOPE("BuildPalette");
+        for (unsigned int i = 0; i < skeleton.Joints.size(); i++)
+        {
+            int bone = skeleton.Joints[i].Bone;
+            if (bone >= 0)
+                palette[bone] = skeleton.GlobalInverseTransform * global[i] * skeleton.BoneOffsets[bone];
+        }
+        FRAME_STAT_ADD(COUNTER_BONES_EVALUATED, skeleton.GetNumBones());
+    }
+
+    inline void EvaluatePose(const Skeleton& skeleton, const AnimationClip& clip, float timeInSeconds, Pose& pose)
+    {
+        SampleLocalPose(skeleton, clip, ClipTime(clip, timeInSeconds), pose.Local);
+        EvaluateHierarchy(skeleton, pose.Local, pose.Global);
+        BuildPalette(skeleton, pose.Global, pose.Palette);
+    }
+
+    // the three stages restricted to the joints of a skeleton LOD, the pruned joints are left untouched
+    inline void SampleLocalPose(const Skeleton& skeleton, const SkeletonLod& lod, const AnimationClip& clip, float animationTime, std::vector<glm::mat4>& local)
+    {
+        PROFILE_SCOPE("SampleLocalPose");
+        for (unsigned int i = 0; i < lod.Joints.size(); i++)
+            local[lod.Joints[i]] = skeleton.Joints[lod.Joints[i]].LocalTransform;
+
+        unsigned int searchSteps = 0, sampled = 0;
+        for (unsigned int i = 0; i < clip.Channels.size(); i++)
+        {
+            const AnimationChannel& channel = clip.Channels[i];
+            if (!lod.Keep[channel.Joint])
+                continue;
+            glm::vec3 scale = calcInterpolatedVector(animationTime, channel.ScalingKeys, searchSteps);
+            glm::quat rotate = calcInterpolatedRotation(animationTime, channel.RotationKeys, searchSteps);
+            glm::vec3 translate = calcInterpolatedVector(animationTime, channel.PositionKeys, searchSteps);
+            local[channel.Joint] = glm::translate(glm::mat4(1.0f), translate) * glm::toMat4(rotate) * glm::scale(glm::mat4(1.0f), scale);
+            sampled++;
+        }
+        FRAME_STAT_ADD(COUNTER_CHANNELS_SAMPLED, sampled);
+        FRAME_STAT_ADD(COUNTER_KEY_SEARCH_STEPS, searchSteps);
+    }
+
+    inline void EvaluateHierarchy(const Skeleton& skeleton, const SkeletonLod& lod, const std::vector<glm::mat4>& local, std::vector<glm::mat4>& global)
+    {
+        PROFILE_SCOPE("EvaluateHierarchy");
+        for (unsigned int i = 0; i < lod.Joints.size(); i++)
+        {
+            unsigned int joint = lod.Joints[i];
+            int parent = skeleton.Joints[joint].Parent;
+            global[joint] = parent >= 0 ? global[parent] * local[joint] : local[joint];
+        }
+    }
+
+    inline void BuildPalette(const Skeleton& skeleton, const SkeletonLod& lod, const std::vector<glm::mat4>& global, std::vector<glm::mat4>& palette)
+    {
+        PROFILE_SCOPE("BuildPalette");
+        unsigned int evaluated = 0;
+        for (unsigned int i = 0; i < lod.Joints.size(); i++)
+        {
+            int bone = skeleton.Joints[lod.Joints[i]].Bone;
+            if (bone >= 0)
+            {
+                palette[bone] = skeleton.GlobalInverseTransform * global[lod.Joints[i]] * skeleton.BoneOffsets[bone];
+                evaluated++;
+            }
+        }
+        for (unsigned int i = 0; i < lod.PrunedBones.size(); i++)
+        {
+            const SkeletonLod::PrunedBone& pruned = lod.PrunedBones[i];
+            palette[pruned.Bone] = skeleton.GlobalInverseTransform * global[pruned.Ancestor] * pruned.Offset;
+        }
+        FRAME_STAT_ADD(COUNTER_BONES_EVALUATED, evaluated);
+    }
+
+    inline void EvaluatePose(const Skeleton& skeleton, const SkeletonLod& lod, const AnimationClip& clip, float timeInSeconds, Pose& pose)
+    {
+        SampleLocalPose(skeleton, lod, clip, ClipTime(clip, timeInSeconds), pose.Local);
+        EvaluateHierarchy(skeleton, lod, pose.Local, pose.Global);
+        BuildPalette(skeleton, lod, pose.Global, pose.Palette);
+    }
+
+    // builds skeleton.Lods from the bone bounds: a joint is kept at a level while the skin moved
+    // by its subtree is at least SKELETON_LOD_MIN_EXTENT of the model size
+    inline void BuildSkeletonLods(Skeleton& skeleton)
+    {
+        unsigned int numJoints = (unsigned int)skeleton.Joints.size();
+        // union of the bone bounds of every subtree, children come after their parents
+        std::vector<glm::vec3> subtreeMin(numJoints, glm::vec3(1e30f)), subtreeMax(numJoints, glm::vec3(-1e30f));
+        for (unsigned int i = numJoints; i-- > 0; )
+        {
+            int bone = skeleton.Joints[i].Bone;
+            if (bone >= 0 && bone < (int)skeleton.BoneBoundsMin.size())
+            {
+                subtreeMin[i] = glm::min(subtreeMin[i], skeleton.BoneBoundsMin[bone]);
+                subtreeMax[i] = glm::max(subtreeMax[i], skeleton.BoneBoundsMax[bone]);
+            }
+            int parent = skeleton.Joints[i].Parent;
+            if (parent >= 0)
+            {
+                subtreeMin[parent] = glm::min(subtreeMin[parent], subtreeMin[i]);
+                subtreeMax[parent] = glm::max(subtreeMax[parent], subtreeMax[i]);
+            }
+        }
+        std::vector<float> extent(numJoints, 0.0f);
+        for (unsigned int i = 0; i < numJoints; i++)
+            if (subtreeMin[i].x <= subtreeMax[i].x)
+                extent[i] = glm::length(subtreeMax[i] - subtreeMin[i]);
+        float modelSize = numJoints > 0 ? extent[0] : 0.0f;
+
+        skeleton.Lods.assign(SKELETON_LOD_LEVELS, SkeletonLod());
+        for (unsigned int level = 0; level < SKELETON_LOD_LEVELS; level++)
+        {
+            SkeletonLod& lod = skeleton.Lods[level];
+            lod.Keep.assign(numJoints, 0);
+            // rest transform from the closest kept ancestor, for the pruned joints
+            std::vector<glm::mat4> fromAncestor(numJoints, glm::mat4(1.0f));
+            std::vector<unsigned int> ancestor(numJoints, 0);
+            for (unsigned int i = 0; i < numJoints; i++)
+            {
+                const Joint& joint = skeleton.Joints[i];
+                // subtree extents shrink down the hierarchy, so the kept joints always include their parents
+                bool keep = level == 0 || joint.Parent < 0 || extent[i] >= SKELETON_LOD_MIN_EXTENT[level] * modelSize;
+                if (keep)
+                {
+                    lod.Keep[i] = 1;
+                    lod.Joints.push_back(i);
+                    continue;
+                }
+                bool parentKept = lod.Keep[joint.Parent] != 0;
+                ancestor[i] = parentKept ? (unsigned int)joint.Parent : ancestor[joint.Parent];
+                fromAncestor[i] = parentKept ? joint.LocalTransform : fromAncestor[joint.Parent] * joint.LocalTransform;
+                if (joint.Bone >= 0)
+                {
+                    SkeletonLod::PrunedBone pruned = { (unsigned int)joint.Bone, ancestor[i], fromAncestor[i] * skeleton.BoneOffsets[joint.Bone] };
+                    lod.PrunedBones.push_back(pruned);
+                }
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,448 @@
+#ifndef ANIMATION_LAYERS_H
+#define ANIMATION_LAYERS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include "animation.hpp"
+#include "frame_stats.hpp"
+#include "profiler.hpp"
+#include "simd.hpp"
+
+// Layered animation: a base clip plus override or additive layers (upper body aiming, hit
+// reactions) restricted to a subtree of the skeleton by a per-joint weight mask built at load
+// from joint names. The layered path samples the base clip into translation, rotation and
+// scale arrays, one array per component (SoA), samples each layer only for the channels of its
+// masked joints, blends four joints at a time with SSE2 over the blocks of four joints that have
+// a weight, and composes the local matrices the hierarchy stage expects. A layer costs one
+// partial sample and a blend over its masked joints.
+
+// joints are processed in blocks of this many
+const unsigned int LAYER_BLOCK = 4;
+
+enum class LayerBlend
+{
+    Override, // replaces the masked joints, by their weight
+    Additive  // adds the motion of its clip relative to the clip's first frame
+};
+
+// Local transforms of a skeleton as translation, rotation and scale arrays, padded to a
+// multiple of LAYER_BLOCK joints
+struct LocalPoseSoA
+{
+    std::vector<float> Tx, Ty, Tz;
+    std::vector<float> Qx, Qy, Qz, Qw;
+    std::vector<float> Sx, Sy, Sz;
+
+    void Resize(unsigned int joints)
+    {
+        unsigned int padded = (joints + LAYER_BLOCK - 1) / LAYER_BLOCK * LAYER_BLOCK;
+        std::vector<float>* components[10] = { &Tx, &Ty, &Tz, &Qx, &Qy, &Qz, &Qw, &Sx, &Sy, &Sz };
+        for (unsigned int c = 0; c < 10; c++)
+            components[c]->resize(padded, 0.0f);
+    }
+
+    unsigned int GetPaddedSize() const { return (unsigned int)Tx.size(); }
+
+    void Set(unsigned int joint, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+    {
+        Tx[joint] = translation.x; Ty[joint] = translation.y; Tz[joint] = translation.z;
+        Qx[joint] = rotation.x; Qy[joint] = rotation.y; Qz[joint] = rotation.z; Qw[joint] = rotation.w;
+        Sx[joint] = scale.x; Sy[joint] = scale.y; Sz[joint] = scale.z;
+    }
+
+    // copies the joints [begin, end) of other
+    void CopyRange(const LocalPoseSoA& other, unsigned int begin, unsigned int end)
+    {
+        const std::vector<float>* from[10] = { &other.Tx, &other.Ty, &other.Tz, &other.Qx, &other.Qy, &other.Qz, &other.Qw, &other.Sx, &other.Sy, &other.Sz };
+        std::vector<float>* to[10] = { &Tx, &Ty, &Tz, &Qx, &Qy, &Qz, &Qw, &Sx, &Sy, &Sz };
+        for (unsigned int c = 0; c < 10; c++)
+            std::copy(from[c]->begin() + begin, from[c]->begin() + end, to[c]->begin() + begin);
+    }
+
+    size_t GetCPUBytes() const { return sizeof(LocalPoseSoA) + 10 * Tx.capacity() * sizeof(float); }
+};
+
+// Weight of a layer on every joint, and the blocks of LAYER_BLOCK joints with any weight
+struct BoneMask
+{
+    std::vector<float> Weights;
+    std::vector<unsigned int> Blocks;
+};
+
+// One layer as given on the command line: "override|additive,CLIP,JOINT[+JOINT...][,WEIGHT]"
+struct LayerDesc
+{
+    LayerBlend Blend;
+    unsigned int Clip;
+    // roots of the masked subtrees
+    std::vector<std::string> Joints;
+    float Weight;
+
+    LayerDesc() : Blend(LayerBlend::Override), Clip(0), Weight(1.0f) {}
+
+    static bool Parse(const std::string& text, LayerDesc& desc)
+    {
+        std::vector<std::string> fields;
+        std::stringstream stream(text);
+        std::string field;
+        while (std::getline(stream, field, ','))
+            fields.push_back(field);
+        if (fields.size() < 3 || fields.size() > 4)
+            return false;
+        if (fields[0] == "override")
+            desc.Blend = LayerBlend::Override;
+        else if (fields[0] == "additive")
+            desc.Blend = LayerBlend::Additive;
+        else
+            return false;
+        desc.Clip = (unsigned int)std::atoi(fields[1].c_str());
+        desc.Joints.clear();
+        std::stringstream joints(fields[2]);
+        while (std::getline(joints, field, '+'))
+            if (!field.empty())
+                desc.Joints.push_back(field);
+        desc.Weight = fields.size() == 4 ? (float)std::atof(fields[3].c_str()) : 1.0f;
+        return !desc.Joints.empty() && desc.Weight >= 0.0f && desc.Weight <= 1.0f;
+    }
+};
+
+namespace Animation
+{
+    // index of the joint called name, or whose name ends with ":name" (e.g. "mixamorig:Spine"), -1 if none
+    inline int FindJoint(const Skeleton& skeleton, const std::string& name)
+    {
+        for (unsigned int i = 0; i < skeleton.Joints.size(); i++)
+        {
+            const std::string& joint = skeleton.Joints[i].Name;
+            if (joint == name)
+                return (int)i;
+            if (joint.size() > name.size() && joint[joint.size() - name.size() - 1] == ':' && joint.compare(joint.size() - name.size(), name.size(), name) == 0)
+                return (int)i;
+        }
+        return -1;
+    }
+
+    // weight on the subtrees of the named joints, 0 elsewhere
+    inline BoneMask BuildBoneMask(const Skeleton& skeleton, const std::vector<std::string>& roots, float weight)
+    {
+        BoneMask mask;
+        unsigned int joints = (unsigned int)skeleton.Joints.size();
+        mask.Weights.assign((joints + LAYER_BLOCK - 1) / LAYER_BLOCK * LAYER_BLOCK, 0.0f);
+        for (unsigned int r = 0; r < roots.size(); r++)
+        {
+            int root = FindJoint(skeleton, roots[r]);
+            if (root < 0)
+                std::cout << "ERROR::ANIMATION: No joint named " << roots[r] << std::endl;
+            else
+                mask.Weights[root] = weight;
+        }
+        // parents come first, so the weights flow down the hierarchy in one pass
+        for (unsigned int i = 0; i < joints; i++)
+        {
+            int parent = skeleton.Joints[i].Parent;
+            if (mask.Weights[i] == 0.0f && parent >= 0)
+                mask.Weights[i] = mask.Weights[parent];
+        }
+        for (unsigned int block = 0; block < mask.Weights.size(); block += LAYER_BLOCK)
+            for (unsigned int i = block; i < block + LAYER_BLOCK; i++)
+                if (mask.Weights[i] > 0.0f)
+                {
+                    mask.Blocks.push_back(block);
+                    break;
+                }
+        return mask;
+    }
+
+    // the clip with every key made relative to the first key of its channel, so that adding it
+    // to a pose adds the motion of the clip and not its posture
+    inline AnimationClip MakeAdditiveClip(const AnimationClip& clip)
+    {
+        AnimationClip additive = clip;
+        for (unsigned int c = 0; c < additive.Channels.size(); c++)
+        {
+            AnimationChannel& channel = additive.Channels[c];
+            if (!channel.PositionKeys.empty())
+            {
+                glm::vec3 reference = channel.PositionKeys[0].Value;
+                for (unsigned int k = 0; k < channel.PositionKeys.size(); k++)
+                    channel.PositionKeys[k].Value -= reference;
+            }
+            if (!channel.RotationKeys.empty())
+            {
+                glm::quat inverse = glm::inverse(channel.RotationKeys[0].Value);
+                for (unsigned int k = 0; k < channel.RotationKeys.size(); k++)
+                    channel.RotationKeys[k].Value = glm::normalize(inverse * channel.RotationKeys[k].Value);
+            }
+            if (!channel.ScalingKeys.empty())
+            {
+                glm::vec3 reference = channel.ScalingKeys[0].Value;
+                for (unsigned int k = 0; k < channel.ScalingKeys.size(); k++)
+                    channel.ScalingKeys[k].Value /= reference;
+            }
+        }
+        return additive;
+    }
+
+    // samples channel into pose at animationTime (in ticks), adds the keys visited to steps
+    inline void sampleChannel(const AnimationChannel& channel, float animationTime, LocalPoseSoA& pose, unsigned int& steps)
+    {
+        pose.Set(channel.Joint, calcInterpolatedVector(animationTime, channel.PositionKeys, steps),
+                 calcInterpolatedRotation(animationTime, channel.RotationKeys, steps),
+                 calcInterpolatedVector(animationTime, channel.ScalingKeys, steps));
+    }
+
+#ifdef SKANIM_SSE2
+    inline __m128 dot4(__m128 ax, __m128 ay, __m128 az, __m128 aw, __m128 bx, __m128 by, __m128 bz, __m128 bw)
+    {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+    }
+
+    // no _mm_rsqrt_ps: its 12 bits would drift over the layers
+    inline void normalize4(__m128& x, __m128& y, __m128& z, __m128& w)
+    {
+        __m128 scale = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(dot4(x, y, z, w, x, y, z, w)));
+        x = _mm_mul_ps(x, scale);
+        y = _mm_mul_ps(y, scale);
+        z = _mm_mul_ps(z, scale);
+        w = _mm_mul_ps(w, scale);
+    }
+
+    inline __m128 lerp4(__m128 a, __m128 b, __m128 t) { return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t)); }
+
+    // b, negated where its dot with a is negative, so they interpolate along the short arc
+    inline void alignQuat4(__m128 sign, __m128& x, __m128& y, __m128& z, __m128& w)
+    {
+        x = _mm_xor_ps(x, sign);
+        y = _mm_xor_ps(y, sign);
+        z = _mm_xor_ps(z, sign);
+        w = _mm_xor_ps(w, sign);
+    }
+#endif
+
+    // blends the block of joints at index begin of layer into pose, by weight per joint
+    inline void blendBlock(LocalPoseSoA& pose, const LocalPoseSoA& layer, LayerBlend blend, const float* weight, unsigned int begin)
+    {
+#ifdef SKANIM_SSE2
+        const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+        const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+        __m128 w = _mm_loadu_ps(weight + begin);
+        __m128 tx = _mm_loadu_ps(&pose.Tx[begin]), ty = _mm_loadu_ps(&pose.Ty[begin]), tz = _mm_loadu_ps(&pose.Tz[begin]);
+        __m128 qx = _mm_loadu_ps(&pose.Qx[begin]), qy = _mm_loadu_ps(&pose.Qy[begin]), qz = _mm_loadu_ps(&pose.Qz[begin]), qw = _mm_loadu_ps(&pose.Qw[begin]);
+        __m128 sx = _mm_loadu_ps(&pose.Sx[begin]), sy = _mm_loadu_ps(&pose.Sy[begin]), sz = _mm_loadu_ps(&pose.Sz[begin]);
+        __m128 lx = _mm_loadu_ps(&layer.Qx[begin]), ly = _mm_loadu_ps(&layer.Qy[begin]), lz = _mm_loadu_ps(&layer.Qz[begin]), lw = _mm_loadu_ps(&layer.Qw[begin]);
+        if (blend == LayerBlend::Override)
+        {
+            tx = lerp4(tx, _mm_loadu_ps(&layer.Tx[begin]), w);
+            ty = lerp4(ty, _mm_loadu_ps(&layer.Ty[begin]), w);
+            tz = lerp4(tz, _mm_loadu_ps(&layer.Tz[begin]), w);
+            sx = lerp4(sx, _mm_loadu_ps(&layer.Sx[begin]), w);
+            sy = lerp4(sy, _mm_loadu_ps(&layer.Sy[begin]), w);
+            sz = lerp4(sz, _mm_loadu_ps(&layer.Sz[begin]), w);
+            // normalized lerp, on the short arc
+            alignQuat4(_mm_and_ps(dot4(qx, qy, qz, qw, lx, ly, lz, lw), signMask), lx, ly, lz, lw);
+            qx = lerp4(qx, lx, w);
+            qy = lerp4(qy, ly, w);
+            qz = lerp4(qz, lz, w);
+            qw = lerp4(qw, lw, w);
+            normalize4(qx, qy, qz, qw);
+        }
+        else
+        {
+            tx = _mm_add_ps(tx, _mm_mul_ps(_mm_loadu_ps(&layer.Tx[begin]), w));
+            ty = _mm_add_ps(ty, _mm_mul_ps(_mm_loadu_ps(&layer.Ty[begin]), w));
+            tz = _mm_add_ps(tz, _mm_mul_ps(_mm_loadu_ps(&layer.Tz[begin]), w));
+            sx = _mm_mul_ps(sx, lerp4(one, _mm_loadu_ps(&layer.Sx[begin]), w));
+            sy = _mm_mul_ps(sy, lerp4(one, _mm_loadu_ps(&layer.Sy[begin]), w));
+            sz = _mm_mul_ps(sz, lerp4(one, _mm_loadu_ps(&layer.Sz[begin]), w));
+            // the delta scaled by the weight, from the identity on the short arc, then applied after the base
+            alignQuat4(_mm_and_ps(lw, signMask), lx, ly, lz, lw);
+            lx = _mm_mul_ps(lx, w);
+            ly = _mm_mul_ps(ly, w);
+            lz = _mm_mul_ps(lz, w);
+            lw = lerp4(one, lw, w);
+            normalize4(lx, ly, lz, lw);
+            __m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qw, lx), _mm_mul_ps(qx, lw)), _mm_sub_ps(_mm_mul_ps(qy, lz), _mm_mul_ps(qz, ly)));
+            __m128 y = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(qw, ly), _mm_mul_ps(qx, lz)), _mm_add_ps(_mm_mul_ps(qy, lw), _mm_mul_ps(qz, lx)));
+            __m128 z = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(qw, lz), _mm_mul_ps(qy, lx)), _mm_add_ps(_mm_mul_ps(qx, ly), _mm_mul_ps(qz, lw)));
+            __m128 ww = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(qw, lw), _mm_mul_ps(qx, lx)), _mm_add_ps(_mm_mul_ps(qy, ly), _mm_mul_ps(qz, lz)));
+            qx = x;
+            qy = y;
+            qz = z;
+            qw = ww;
+        }
+        // joints without weight keep their value exactly
+        __m128 keep = _mm_cmpeq_ps(w, zero);
+        const __m128 blended[10] = { tx, ty, tz, qx, qy, qz, qw, sx, sy, sz };
+        std::vector<float>* components[10] = { &pose.Tx, &pose.Ty, &pose.Tz, &pose.Qx, &pose.Qy, &pose.Qz, &pose.Qw, &pose.Sx, &pose.Sy, &pose.Sz };
+        for (unsigned int c = 0; c < 10; c++)
+        {
+            float* out = &(*components[c])[begin];
+            __m128 old = _mm_loadu_ps(out);
+            _mm_storeu_ps(out, _mm_or_ps(_mm_and_ps(keep, old), _mm_andnot_ps(keep, blended[c])));
+        }
+#else
+        for (unsigned int i = begin; i < begin + LAYER_BLOCK; i++)
+        {
+            float w = weight[i];
+            if (w <= 0.0f)
+                continue;
+            glm::quat base(pose.Qw[i], pose.Qx[i], pose.Qy[i], pose.Qz[i]);
+            glm::quat other(layer.Qw[i], layer.Qx[i], layer.Qy[i], layer.Qz[i]);
+            glm::vec3 translation(layer.Tx[i], layer.Ty[i], layer.Tz[i]), scale(layer.Sx[i], layer.Sy[i], layer.Sz[i]);
+            glm::quat rotation;
+            if (blend == LayerBlend::Override)
+            {
+                if (glm::dot(base, other) < 0.0f)
+                    other = -other;
+                rotation = glm::normalize(base * (1.0f - w) + other * w);
+                translation = glm::mix(glm::vec3(pose.Tx[i], pose.Ty[i], pose.Tz[i]), translation, w);
+                scale = glm::mix(glm::vec3(pose.Sx[i], pose.Sy[i], pose.Sz[i]), scale, w);
+            }
+            else
+            {
+                if (other.w < 0.0f)
+                    other = -other;
+                rotation = base * glm::normalize(glm::quat(1.0f - w + other.w * w, other.x * w, other.y * w, other.z * w));
+                translation = glm::vec3(pose.Tx[i], pose.Ty[i], pose.Tz[i]) + translation * w;
+                scale = glm::vec3(pose.Sx[i], pose.Sy[i], pose.Sz[i]) * glm::mix(glm::vec3(1.0f), scale, w);
+            }
+            pose.Set(i, translation, rotation, scale);
+        }
+#endif
+    }
+
+    // local matrices T * R * S of the first count joints of pose
+    inline void composeLocal(const LocalPoseSoA& pose, unsigned int count, std::vector<glm::mat4>& local)
+    {
+        for (unsigned int i = 0; i < count; i++)
+        {
+            float x = pose.Qx[i], y = pose.Qy[i], z = pose.Qz[i], w = pose.Qw[i];
+            glm::mat4& m = local[i];
+            m[0] = glm::vec4(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + z * w), 2.0f * (x * z - y * w), 0.0f) * pose.Sx[i];
+            m[1] = glm::vec4(2.0f * (x * y - z * w), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + x * w), 0.0f) * pose.Sy[i];
+            m[2] = glm::vec4(2.0f * (x * z + y * w), 2.0f * (y * z - x * w), 1.0f - 2.0f * (x * x + y * y), 0.0f) * pose.Sz[i];
+            m[3] = glm::vec4(pose.Tx[i], pose.Ty[i], pose.Tz[i], 1.0f);
+        }
+    }
+}
+
+// per-evaluation scratch of a LayerStack, one per thread
+struct LayerScratch
+{
+    LocalPoseSoA Pose;
+    LocalPoseSoA Layer;
+};
+
+// The layers of one skeleton, shared by the instances playing them
+class LayerStack
+{
+    public:
+        LayerStack() : numJoints(0) {}
+
+        explicit LayerStack(const Skeleton& skeleton) : numJoints((unsigned int)skeleton.Joints.size())
+        {
+            bind.Resize(numJoints);
+            identity.Resize(numJoints);
+            for (unsigned int i = 0; i < bind.GetPaddedSize(); i++)
+            {
+                identity.Set(i, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+                bind.Set(i, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+            }
+            for (unsigned int i = 0; i < numJoints; i++)
+            {
+                const glm::mat4& transform = skeleton.Joints[i].LocalTransform;
+                glm::vec3 x = glm::vec3(transform[0]), y = glm::vec3(transform[1]), z = glm::vec3(transform[2]);
+                glm::vec3 scale(glm::length(x), glm::length(y), glm::length(z));
+                glm::mat3 rotation = glm::mat3(x / scale.x, y / scale.y, z / scale.z);
+                bind.Set(i, glm::vec3(transform[3]), glm::normalize(glm::quat_cast(rotation)), scale);
+            }
+        }
+
+        // a layer playing clip on the subtrees of the named joints, with weight
+        void AddLayer(const Skeleton& skeleton, const AnimationClip& clip, LayerBlend blend, const std::vector<std::string>& joints, float weight)
+        {
+            Layer layer;
+            layer.Clip = blend == LayerBlend::Additive ? Animation::MakeAdditiveClip(clip) : clip;
+            layer.Blend = blend;
+            layer.Mask = Animation::BuildBoneMask(skeleton, joints, weight);
+            // only the channels of masked joints are ever sampled
+            for (unsigned int c = 0; c < layer.Clip.Channels.size(); c++)
+                if (layer.Mask.Weights[layer.Clip.Channels[c].Joint] > 0.0f)
+                    layer.Channels.push_back(c);
+            layers.push_back(layer);
+        }
+
+        unsigned int GetNumLayers() const { return (unsigned int)layers.size(); }
+        unsigned int GetNumJoints() const { return numJoints; }
+
+        // the base clip at baseTime plus every layer at the time of the same index (all in seconds)
+        // into local. scratch is resized on first use.
+        void Evaluate(const AnimationClip& base, float baseTime, const float* layerTimes, LayerScratch& scratch, std::vector<glm::mat4>& local) const
+        {
+            PROFILE_SCOPE("LayerStack::Evaluate");
+            if (scratch.Pose.GetPaddedSize() < bind.GetPaddedSize())
+            {
+                scratch.Pose.Resize(numJoints);
+                scratch.Layer.Resize(numJoints);
+            }
+            unsigned int steps = 0, channels = (unsigned int)base.Channels.size();
+            scratch.Pose.CopyRange(bind, 0, bind.GetPaddedSize());
+            float animationTime = Animation::ClipTime(base, baseTime);
+            for (unsigned int c = 0; c < base.Channels.size(); c++)
+                Animation::sampleChannel(base.Channels[c], animationTime, scratch.Pose, steps);
+
+            for (unsigned int l = 0; l < layers.size(); l++)
+            {
+                const Layer& layer = layers[l];
+                // the masked joints the clip doesn't animate hold the bind pose, or add nothing
+                const LocalPoseSoA& rest = layer.Blend == LayerBlend::Additive ? identity : bind;
+                for (unsigned int b = 0; b < layer.Mask.Blocks.size(); b++)
+                    scratch.Layer.CopyRange(rest, layer.Mask.Blocks[b], layer.Mask.Blocks[b] + LAYER_BLOCK);
+                animationTime = Animation::ClipTime(layer.Clip, layerTimes[l]);
+                for (unsigned int c = 0; c < layer.Channels.size(); c++)
+                    Animation::sampleChannel(layer.Clip.Channels[layer.Channels[c]], animationTime, scratch.Layer, steps);
+                for (unsigned int b = 0; b < layer.Mask.Blocks.size(); b++)
+                    Animation::blendBlock(scratch.Pose, scratch.Layer, layer.Blend, &layer.Mask.Weights[0], layer.Mask.Blocks[b]);
+                channels += (unsigned int)layer.Channels.size();
+            }
+            Animation::composeLocal(scratch.Pose, numJoints, local);
+            FRAME_STAT_ADD(COUNTER_CHANNELS_SAMPLED, channels);
+            FRAME_STAT_ADD(COUNTER_KEY_SEARCH_STEPS, steps);
+        }
+
+        size_t GetCPUBytes() const
+        {
+            size_t bytes = sizeof(LayerStack) + bind.GetCPUBytes() + identity.GetCPUBytes();
+            for (unsigned int l = 0; l < layers.size(); l++)
+                bytes += layers[l].Clip.GetCPUBytes() + layers[l].Mask.Weights.capacity() * sizeof(float)
+                    + (layers[l].Mask.Blocks.capacity() + layers[l].Channels.capacity()) * sizeof(unsigned int);
+            return bytes;
+        }
+
+    private:
+        struct Layer
+        {
+            AnimationClip Clip;
+            LayerBlend Blend;
+            BoneMask Mask;
+            // channels of Clip on masked joints
+            std::vector<unsigned int> Channels;
+        };
+
+        unsigned int numJoints;
+        // the bind pose, and the pose that adds nothing
+        LocalPoseSoA bind;
+        LocalPoseSoA identity;
+        std::vector<Layer> layers;
+};
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef ANIMATION_LOD_H
+#define ANIMATION_LOD_H
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "animation.hpp"
+#include "mesh.hpp"
+
+// Animation level of detail: instances that cover little of the screen update their pose
+// less often. Tier n evaluates the pose every 2^n frames. The frames in between blend the
+// last two evaluated palettes, so the pose stays smooth but lags by up to one interval.
+// Independently, smaller instances evaluate a coarser skeleton LOD, which leaves out the
+// joints that only move a small part of the skin (see SkeletonLod), and draw a simplified
+// mesh (see MeshLod).
+
+const unsigned int ANIMATION_LOD_TIERS = 4;
+
+struct AnimationLodSettings
+{
+    bool Enabled;
+    // smallest screen height fraction that still gets tier 0, 1 and 2, anything smaller gets tier 3
+    float ScreenFractions[ANIMATION_LOD_TIERS - 1];
+    bool SkeletonEnabled;
+    // smallest screen height fraction that still gets skeleton LOD 0, 1 and 2, anything smaller gets 3
+    float SkeletonFractions[SKELETON_LOD_LEVELS - 1];
+    bool MeshEnabled;
+    // smallest screen height fraction that still gets mesh LOD 0, 1 and 2, anything smaller gets 3
+    float MeshFractions[MESH_LOD_LEVELS - 1];
+
+    AnimationLodSettings() : Enabled(true), SkeletonEnabled(true), MeshEnabled(true)
+    {
+        ScreenFractions[0] = 0.25f;
+        ScreenFractions[1] = 0.10f;
+        ScreenFractions[2] = 0.04f;
+        SkeletonFractions[0] = 0.20f;
+        SkeletonFractions[1] = 0.08f;
+        SkeletonFractions[2] = 0.03f;
+        MeshFractions[0] = 0.15f;
+        MeshFractions[1] = 0.06f;
+        MeshFractions[2] = 0.025f;
+    }
+
+    static unsigned int UpdateInterval(unsigned int tier) { return 1u << tier; }
+
+    unsigned int SelectTier(float screenFraction) const
+    {
+        if (!Enabled)
+            return 0;
+        for (unsigned int tier = 0; tier < ANIMATION_LOD_TIERS - 1; tier++)
+            if (screenFraction >= ScreenFractions[tier])
+                return tier;
+        return ANIMATION_LOD_TIERS - 1;
+    }
+
+    unsigned int SelectSkeletonLod(float screenFraction) const
+    {
+        if (!SkeletonEnabled)
+            return 0;
+        for (unsigned int level = 0; level < SKELETON_LOD_LEVELS - 1; level++)
+            if (screenFraction >= SkeletonFractions[level])
+                return level;
+        return SKELETON_LOD_LEVELS - 1;
+    }
+
+    unsigned int SelectMeshLod(float screenFraction) const
+    {
+        if (!MeshEnabled)
+            return 0;
+        for (unsigned int level = 0; level < MESH_LOD_LEVELS - 1; level++)
+            if (screenFraction >= MeshFractions[level])
+                return level;
+        return MESH_LOD_LEVELS - 1;
+    }
+
+    // "off" or three decreasing fractions, e.g. "0.25,0.1,0.04"
+    bool Parse(const std::string& text) { return parseFractions(text, Enabled, ScreenFractions); }
+    bool ParseSkeleton(const std::string& text) { return parseFractions(text, SkeletonEnabled, SkeletonFractions); }
+    bool ParseMesh(const std::string& text) { return parseFractions(text, MeshEnabled, MeshFractions); }
+
+    static bool parseFractions(const std::string& text, bool& enabled, float fractions[3])
+    {
+        if (text == "off")
+        {
+            enabled = false;
+            return true;
+        }
+        std::stringstream stream(text);
+        std::string item;
+        unsigned int count = 0;
+        while (std::getline(stream, item, ','))
+        {
+            if (count == 3)
+                return false;
+            fractions[count++] = (float)std::atof(item.c_str());
+        }
+        enabled = true;
+        return count == 3 && fractions[0] >= fractions[1] && fractions[1] >= fractions[2];
+    }
+};
+
+namespace AnimationLod
+{
+    // fraction of the screen height covered by a sphere, 1 when the camera is inside it
+    inline float ProjectedScreenFraction(const glm::vec3& center, float radius, const glm::vec3& camera, float tanHalfFovY)
+    {
+        float distance = glm::length(center - camera);
+        if (distance <= radius)
+            return 1.0f;
+        return radius / (distance * tanHalfFovY);
+    }
+
+    // componentwise blend of two palettes, cheap and close enough for the small steps between two updates
+    inline void BlendPalettes(const std::vector<glm::mat4>& from, const std::vector<glm::mat4>& to, float factor, std::vector<glm::mat4>& out)
+    {
+        for (unsigned int i = 0; i < out.size(); i++)
+            out[i] = from[i] + (to[i] - from[i]) * factor;
+    }
+}
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "animation.hpp"
+#include "simd.hpp"
+
+// Bounding volumes for culling: the per-bone boxes of the bind pose are carried through the
+// bone palette to bound the posed skin, and world boxes are tested against the view frustum.
+// The box transforms use the center/extent form, with SSE2 where the compiler targets it.
+
+struct BoundingBox
+{
+    glm::vec3 Min;
+    glm::vec3 Max;
+
+    BoundingBox() : Min(1e30f), Max(-1e30f) {}
+    BoundingBox(const glm::vec3& min, const glm::vec3& max) : Min(min), Max(max) {}
+
+    bool IsEmpty() const { return Min.x > Max.x; }
+};
+
+namespace Bounds
+{
+#ifdef SKANIM_SSE2
+    inline __m128 load3(const glm::vec3& v) { return _mm_set_ps(0.0f, v.z, v.y, v.x); }
+
+    inline glm::vec3 store3(__m128 v)
+    {
+        float out[4];
+        _mm_storeu_ps(out, v);
+        return glm::vec3(out[0], out[1], out[2]);
+    }
+
+    // center and extent of the box around the box (center, extent) moved by matrix
+    inline void transformBox(const glm::mat4& matrix, __m128 center, __m128 extent, __m128& outCenter, __m128& outExtent)
+    {
+        const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+        __m128 column0 = _mm_loadu_ps(&matrix[0].x);
+        __m128 column1 = _mm_loadu_ps(&matrix[1].x);
+        __m128 column2 = _mm_loadu_ps(&matrix[2].x);
+        __m128 column3 = _mm_loadu_ps(&matrix[3].x);
+        __m128 x = _mm_shuffle_ps(center, center, _MM_SHUFFLE(0, 0, 0, 0));
+        __m128 y = _mm_shuffle_ps(center, center, _MM_SHUFFLE(1, 1, 1, 1));
+        __m128 z = _mm_shuffle_ps(center, center, _MM_SHUFFLE(2, 2, 2, 2));
+        outCenter = _mm_add_ps(_mm_add_ps(_mm_mul_ps(column0, x), _mm_mul_ps(column1, y)), _mm_add_ps(_mm_mul_ps(column2, z), column3));
+        x = _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(0, 0, 0, 0));
+        y = _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(1, 1, 1, 1));
+        z = _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(2, 2, 2, 2));
+        outExtent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, column0), x), _mm_mul_ps(_mm_andnot_ps(signMask, column1), y)),
+                               _mm_mul_ps(_mm_andnot_ps(signMask, column2), z));
+    }
+#else
+    inline void transformBox(const glm::mat4& matrix, const glm::vec3& center, const glm::vec3& extent, glm::vec3& outCenter, glm::vec3& outExtent)
+    {
+        for (unsigned int i = 0; i < 3; i++)
+        {
+            outCenter[i] = matrix[0][i] * center.x + matrix[1][i] * center.y + matrix[2][i] * center.z + matrix[3][i];
+            outExtent[i] = std::fabs(matrix[0][i]) * extent.x + std::fabs(matrix[1][i]) * extent.y + std::fabs(matrix[2][i]) * extent.z;
+        }
+    }
+#endif
+
+    // box around box moved by matrix (affine)
+    inline BoundingBox TransformBox(const glm::mat4& matrix, const BoundingBox& box)
+    {
+        if (box.IsEmpty())
+            return box;
+#ifdef SKANIM_SSE2
+        const __m128 half = _mm_set1_ps(0.5f);
+        __m128 min = load3(box.Min), max = load3(box.Max);
+        __m128 center, extent;
+        transformBox(matrix, _mm_mul_ps(_mm_add_ps(min, max), half), _mm_mul_ps(_mm_sub_ps(max, min), half), center, extent);
+        return BoundingBox(store3(_mm_sub_ps(center, extent)), store3(_mm_add_ps(center, extent)));
+#else
+        glm::vec3 center, extent;
+        transformBox(matrix, (box.Min + box.Max) * 0.5f, (box.Max - box.Min) * 0.5f, center, extent);
+        return BoundingBox(center - extent, center + extent);
+#endif
+    }
+
+    // box around the skin posed by palette: the union of the bone boxes, each moved by its palette
+    // matrix. Empty when the skeleton has no bone bounds.
+    inline BoundingBox AnimatedBounds(const Skeleton& skeleton, const std::vector<glm::mat4>& palette)
+    {
+        unsigned int numBones = (unsigned int)std::min(skeleton.BoneBoundsMin.size(), palette.size());
+#ifdef SKANIM_SSE2
+        const __m128 half = _mm_set1_ps(0.5f);
+        __m128 resultMin = _mm_set1_ps(1e30f), resultMax = _mm_set1_ps(-1e30f);
+        for (unsigned int bone = 0; bone < numBones; bone++)
+        {
+            const glm::vec3& boneMin = skeleton.BoneBoundsMin[bone];
+            const glm::vec3& boneMax = skeleton.BoneBoundsMax[bone];
+            // bones that don't move any vertex
+            if (boneMin.x > boneMax.x)
+                continue;
+            __m128 min = load3(boneMin), max = load3(boneMax);
+            __m128 center, extent;
+            transformBox(palette[bone], _mm_mul_ps(_mm_add_ps(min, max), half), _mm_mul_ps(_mm_sub_ps(max, min), half), center, extent);
+            resultMin = _mm_min_ps(resultMin, _mm_sub_ps(center, extent));
+            resultMax = _mm_max_ps(resultMax, _mm_add_ps(center, extent));
+        }
+        return BoundingBox(store3(resultMin), store3(resultMax));
+#else
+        BoundingBox result;
+        for (unsigned int bone = 0; bone < numBones; bone++)
+        {
+            BoundingBox box = TransformBox(palette[bone], BoundingBox(skeleton.BoneBoundsMin[bone], skeleton.BoneBoundsMax[bone]));
+            if (box.IsEmpty())
+                continue;
+            result.Min = glm::min(result.Min, box.Min);
+            result.Max = glm::max(result.Max, box.Max);
+        }
+        return result;
+#endif
+    }
+}
+
+// The six planes of a view-projection matrix, pointing inwards (Gribb and Hartmann).
+struct Frustum
+{
+    glm::vec4 Planes[6];
+
+    Frustum() {}
+
+    explicit Frustum(const glm::mat4& viewProjection)
+    {
+        glm::vec4 rows[4];
+        for (unsigned int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        for (unsigned int i = 0; i < 3; i++)
+        {
+            Planes[i * 2] = rows[3] + rows[i];
+            Planes[i * 2 + 1] = rows[3] - rows[i];
+        }
+    }
+
+    // false only when the box is entirely outside one plane, so a few boxes near the corners pass
+    bool Intersects(const BoundingBox& box) const
+    {
+        if (box.IsEmpty())
+            return false;
+        for (unsigned int i = 0; i < 6; i++)
+        {
+            const glm::vec4& plane = Planes[i];
+            // the corner furthest along the plane normal
+            glm::vec3 corner(plane.x >= 0.0f ? box.Max.x : box.Min.x, plane.y >= 0.0f ? box.Max.y : box.Min.y, plane.z >= 0.0f ? box.Max.z : box.Min.z);
+            if (plane.x * corner.x + plane.y * corner.y + plane.z * corner.z + plane.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "timing.hpp"
+
+// A simulation thread running beside the render thread: Start hands it the simulation of the next
+// frame and returns at once, so the render thread can submit the current frame meanwhile, then
+// Wait joins the two before the frame ends. Jobs are passed by reference like WorkerPool's, so
+// the frame doesn't allocate. The thread must not touch GL; everything it produces for the
+// renderer goes through double-buffered frame data.
+
+class FramePipeline
+{
+    public:
+        FramePipeline() : context(nullptr), invoke(nullptr), busy(false), stopping(false), waitMilliseconds(0.0)
+        {
+            worker = std::thread(&FramePipeline::workerLoop, this);
+        }
+
+        ~FramePipeline()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_one();
+            worker.join();
+        }
+
+        // runs job() on the simulation thread; the previous job must have been waited for
+        template <typename Job>
+        void Start(Job& job)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                context = &job;
+                invoke = &invokeJob<Job>;
+                busy = true;
+            }
+            wake.notify_one();
+        }
+
+        // blocks until the job given to Start is done
+        void Wait()
+        {
+            Timer timer;
+            std::unique_lock<std::mutex> lock(mutex);
+            while (busy)
+                done.wait(lock);
+            waitMilliseconds += timer.ElapsedMilliseconds();
+        }
+
+        // time the render thread spent in Wait, that is the simulation longer than the submission
+        double GetWaitMilliseconds() const { return waitMilliseconds; }
+
+    private:
+        std::thread worker;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        void* context;
+        void (*invoke)(void*);
+        bool busy;
+        bool stopping;
+        double waitMilliseconds;
+
+        FramePipeline(const FramePipeline&);
+        FramePipeline& operator=(const FramePipeline&);
+
+        template <typename Job>
+        static void invokeJob(void* job) { (*(Job*)job)(); }
+
+        void workerLoop()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true)
+            {
+                while (!stopping && (!busy || invoke == nullptr))
+                    wake.wait(lock);
+                if (stopping)
+                    return;
+                void (*job)(void*) = invoke;
+                invoke = nullptr;
+                lock.unlock();
+                job(context);
+                lock.lock();
+                busy = false;
+                done.notify_one();
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,248 @@
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <glad/glad.h>
+
+#include "frame_stats.hpp"
+#include "timing.hpp"
+
+// Per-frame dynamic data (bone palettes) written straight into GL buffer memory. With buffer
+// storage (GL 4.4 or ARB_buffer_storage) one buffer holds FRAME_RING_FRAMES regions and stays
+// mapped for its whole life: a frame writes its region once the fence of the frame that last
+// used it has signalled, so neither the driver copies nor the CPU waits on the GPU in the usual
+// case. The 4.1 context of the demo lacks it, so there the buffer is orphaned every frame and
+// mapped unsynchronized, which lets the driver hand out fresh memory instead of stalling.
+//
+// Allocate only bumps an atomic offset, so worker threads can fill the frame in parallel. When
+// persistent, a frame may be written while the previous one is still being drawn: BeginFrame
+// returns the region it opened, and EndFrame fences the region of the frame whose draws are done.
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+// frames the CPU may run ahead of the GPU
+const unsigned int FRAME_RING_FRAMES = 3;
+
+namespace FrameRing
+{
+    typedef void (APIENTRYP BufferStorageFunction)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+    // glBufferStorage, which the 4.1 loader doesn't know about; nullptr when the context lacks it
+    inline BufferStorageFunction& bufferStorage()
+    {
+        static BufferStorageFunction function = nullptr;
+        return function;
+    }
+
+    // to call after gladLoadGLLoader with the same loader
+    inline void LoadBufferStorage(GLADloadproc load)
+    {
+        GLint major = 0, minor = 0, extensions = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        bool supported = major > 4 || (major == 4 && minor >= 4);
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+        for (GLint i = 0; i < extensions && !supported; i++)
+            supported = std::strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_buffer_storage") == 0;
+        bufferStorage() = supported ? (BufferStorageFunction)load("glBufferStorage") : nullptr;
+    }
+}
+
+struct RingAllocation
+{
+    // nullptr when the frame is full
+    void* Data;
+    GLintptr Offset;
+};
+
+class FrameRingBuffer
+{
+    public:
+        FrameRingBuffer() : target(GL_UNIFORM_BUFFER), buffer(0), persistent(false), frameBytes(0), regionBytes(0), alignment(1),
+            mapped(nullptr), frame(0), region(0), stallMilliseconds(0.0), overflows(0)
+        {
+            head.store(0);
+            for (unsigned int i = 0; i < FRAME_RING_FRAMES; i++)
+                fences[i] = 0;
+        }
+
+        ~FrameRingBuffer() { Shutdown(); }
+
+        // room for frameBytes a frame in up to maxAllocations allocations. tailBytes past the last one
+        // stay readable, for bindings whose range is larger than what was written.
+        bool Init(GLenum target, size_t frameBytes, unsigned int maxAllocations, size_t tailBytes = 0)
+        {
+            Shutdown();
+            this->target = target;
+            GLint offsetAlignment = 16;
+            if (target == GL_UNIFORM_BUFFER)
+                glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+            alignment = offsetAlignment > 0 ? (size_t)offsetAlignment : 1;
+            this->frameBytes = frameBytes + (size_t)maxAllocations * (alignment - 1);
+            regionBytes = alignUp(this->frameBytes + tailBytes);
+
+            glGenBuffers(1, &buffer);
+            glBindBuffer(target, buffer);
+            persistent = FrameRing::bufferStorage() != nullptr;
+            if (persistent)
+            {
+                GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+                FrameRing::bufferStorage()(target, regionBytes * FRAME_RING_FRAMES, nullptr, flags);
+                mapped = (char*)glMapBufferRange(target, 0, regionBytes * FRAME_RING_FRAMES, flags);
+                if (mapped == nullptr)
+                {
+                    std::cout << "ERROR::FRAME_RING: Failed to map the buffer persistently, orphaning instead" << std::endl;
+                    glBindBuffer(target, 0);
+                    glDeleteBuffers(1, &buffer);
+                    glGenBuffers(1, &buffer);
+                    glBindBuffer(target, buffer);
+                    persistent = false;
+                }
+            }
+            if (!persistent)
+                glBufferData(target, regionBytes, nullptr, GL_STREAM_DRAW);
+            glBindBuffer(target, 0);
+            return buffer != 0;
+        }
+
+        void Shutdown()
+        {
+            if (buffer == 0)
+                return;
+            for (unsigned int i = 0; i < FRAME_RING_FRAMES; i++)
+            {
+                if (fences[i] != 0)
+                    glDeleteSync(fences[i]);
+                fences[i] = 0;
+            }
+            glBindBuffer(target, buffer);
+            if (mapped != nullptr)
+                glUnmapBuffer(target);
+            glBindBuffer(target, 0);
+            glDeleteBuffers(1, &buffer);
+            buffer = 0;
+            mapped = nullptr;
+        }
+
+        // opens the frame for writing: waits for the GPU to release the region (persistent), or
+        // orphans the buffer and maps it (fallback). Returns the region, always 0 for the fallback.
+        unsigned int BeginFrame()
+        {
+            head.store(0);
+            if (persistent)
+            {
+                region = frame++ % FRAME_RING_FRAMES;
+                if (fences[region] != 0)
+                {
+                    GLenum status = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+                    if (status == GL_TIMEOUT_EXPIRED)
+                    {
+                        Timer stall;
+                        while (status == GL_TIMEOUT_EXPIRED)
+                            status = glClientWaitSync(fences[region], 0, 1000000);
+                        stallMilliseconds += stall.ElapsedMilliseconds();
+                    }
+                    glDeleteSync(fences[region]);
+                    fences[region] = 0;
+                }
+                return region;
+            }
+            region = 0;
+            frame++;
+            glBindBuffer(target, buffer);
+            glBufferData(target, regionBytes, nullptr, GL_STREAM_DRAW);
+            mapped = (char*)glMapBufferRange(target, 0, regionBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            glBindBuffer(target, 0);
+            return region;
+        }
+
+        // bytes of the current frame, aligned for binding; safe to call from several threads
+        // between BeginFrame and EndWrites
+        RingAllocation Allocate(size_t bytes)
+        {
+            RingAllocation allocation = { nullptr, 0 };
+            size_t size = alignUp(bytes);
+            size_t offset = head.fetch_add(size);
+            if (mapped == nullptr || offset + size > frameBytes)
+            {
+                overflows.fetch_add(1);
+                return allocation;
+            }
+            allocation.Offset = (GLintptr)(region * regionBytes + offset);
+            allocation.Data = mapped + allocation.Offset;
+            FRAME_STAT_ADD(COUNTER_BYTES_UPLOADED, bytes);
+            return allocation;
+        }
+
+        // the CPU is done writing the frame, its data can be used by draws
+        void EndWrites()
+        {
+            if (persistent || mapped == nullptr)
+                return;
+            glBindBuffer(target, buffer);
+            glUnmapBuffer(target);
+            glBindBuffer(target, 0);
+            mapped = nullptr;
+        }
+
+        // after the last draw reading the frame
+        void EndFrame() { EndFrame(region); }
+
+        // after the last draw reading the frame that wrote frameRegion, which may be older than the
+        // frame open for writing
+        void EndFrame(unsigned int frameRegion)
+        {
+            if (persistent)
+                fences[frameRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+
+        GLuint GetBuffer() const { return buffer; }
+        // the most a frame can allocate, and the alignment of every allocation
+        size_t GetFrameBytes() const { return frameBytes; }
+        size_t GetAlignment() const { return alignment; }
+        bool IsPersistent() const { return persistent; }
+        // bytes written this frame, alignment included
+        size_t GetUsedBytes() const { return std::min(head.load(), frameBytes); }
+        double GetStallMilliseconds() const { return stallMilliseconds; }
+        // allocations refused because their frame was full
+        unsigned int GetNumOverflows() const { return overflows.load(); }
+
+        void PrintSummary(std::ostream& out, const char* name) const
+        {
+            out << name << ": " << (persistent ? "persistent mapping, " : "orphaning, ") << (regionBytes >> 10) << " KB a frame, "
+                << stallMilliseconds << " ms waiting on fences, " << overflows.load() << " allocations over capacity" << std::endl;
+        }
+
+    private:
+        GLenum target;
+        GLuint buffer;
+        bool persistent;
+        size_t frameBytes;
+        size_t regionBytes;
+        size_t alignment;
+        // the whole buffer when persistent, the current frame otherwise
+        char* mapped;
+        unsigned int frame;
+        unsigned int region;
+        std::atomic<size_t> head;
+        GLsync fences[FRAME_RING_FRAMES];
+        double stallMilliseconds;
+        std::atomic<unsigned int> overflows;
+
+        FrameRingBuffer(const FrameRingBuffer&);
+        FrameRingBuffer& operator=(const FrameRingBuffer&);
+
+        size_t alignUp(size_t bytes) const { return (bytes + alignment - 1) / alignment * alignment; }
+};
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Per-frame runtime counters: animation work (bones, channels, keyframe search steps) and
+// GL traffic (draw calls, triangles, state changes, uniform uploads, bytes uploaded). The code adds to
+// the current frame with FRAME_STAT_ADD, EndFrame closes the frame and makes its values
+// readable with GetLast. The hot loops count locally and add once per call, so a counter
+// costs one relaxed atomic add per function rather than per element.
+//
+// Without SKANIM_FRAME_STATS the macro expands to nothing.
+
+enum FrameCounter
+{
+    COUNTER_BONES_EVALUATED,
+    COUNTER_CHANNELS_SAMPLED,
+    COUNTER_KEY_SEARCH_STEPS,
+    COUNTER_DRAW_CALLS,
+    // triangles submitted, after mesh LOD selection
+    COUNTER_TRIANGLES,
+    COUNTER_STATE_CHANGES,
+    // binds the GL state cache skipped because the object was already bound
+    COUNTER_REDUNDANT_BINDS,
+    COUNTER_UNIFORM_UPLOADS,
+    // buffer, texture and uniform data handed to GL
+    COUNTER_BYTES_UPLOADED,
+    // instances outside the view, neither uploaded nor drawn
+    COUNTER_INSTANCES_CULLED,
+    // culled instances hidden behind occluders, and the occluder triangles rasterized on the CPU
+    COUNTER_INSTANCES_OCCLUDED,
+    COUNTER_OCCLUDER_TRIANGLES,
+    // instances in each animation update-rate tier (every frame, 2nd, 4th, 8th frame)
+    COUNTER_ANIMATION_TIER_0,
+    COUNTER_ANIMATION_TIER_1,
+    COUNTER_ANIMATION_TIER_2,
+    COUNTER_ANIMATION_TIER_3,
+    // evaluations the pose cache saved, and the poses it had to evaluate
+    COUNTER_POSE_CACHE_HITS,
+    COUNTER_POSE_CACHE_MISSES,
+    COUNTER_COUNT
+};
+
+class FrameStats
+{
+    public:
+        static FrameStats& Get()
+        {
+            static FrameStats instance;
+            return instance;
+        }
+
+        static const char* GetName(FrameCounter counter)
+        {
+            static const char* names[COUNTER_COUNT] = {
+                "bones_evaluated", "channels_sampled", "key_search_steps",
+                "draw_calls", "triangles", "state_changes", "redundant_binds", "uniform_uploads", "bytes_uploaded",
+                "instances_culled", "instances_occluded", "occluder_triangles",
+                "animation_tier_0", "animation_tier_1", "animation_tier_2", "animation_tier_3",
+                "pose_cache_hits", "pose_cache_misses"
+            };
+            return names[counter];
+        }
+
+        void Add(FrameCounter counter, uint64_t value)
+        {
+            current[counter].fetch_add(value, std::memory_order_relaxed);
+        }
+
+        // closes the frame: its values move to GetLast and the counters start again from zero
+        void EndFrame()
+        {
+            for (unsigned int i = 0; i < COUNTER_COUNT; i++)
+            {
+                last[i] = current[i].exchange(0, std::memory_order_relaxed);
+                total[i] += last[i];
+            }
+            frames++;
+            if (csv.is_open())
+                writeCsvRow();
+        }
+
+        // drops what was counted since the last frame, e.g. the uploads done while loading
+        void DiscardCurrent()
+        {
+            for (unsigned int i = 0; i < COUNTER_COUNT; i++)
+                current[i].store(0, std::memory_order_relaxed);
+        }
+
+        // counters of the last closed frame
+        uint64_t GetLast(FrameCounter counter) const { return last[counter]; }
+        // sums over every closed frame
+        uint64_t GetTotal(FrameCounter counter) const { return total[counter]; }
+        unsigned int GetNumFrames() const { return frames; }
+
+        // writes one row per frame from now on, the file is opened here so the frame loop doesn't allocate
+        bool OpenCsv(const std::string& path)
+        {
+            csv.open(path.c_str());
+            if (!csv)
+            {
+                std::cout << "ERROR::FRAME_STATS: Failed to write " << path << std::endl;
+                return false;
+            }
+            csv << "frame";
+            for (unsigned int i = 0; i < COUNTER_COUNT; i++)
+                csv << ',' << GetName((FrameCounter)i);
+            csv << '\n';
+            return true;
+        }
+
+        void CloseCsv() { csv.close(); }
+
+        void PrintLast(std::ostream& out) const
+        {
+            out << "Frame " << frames << ":";
+            for (unsigned int i = 0; i < COUNTER_COUNT; i++)
+                out << ' ' << GetName((FrameCounter)i) << '=' << last[i];
+            out << std::endl;
+        }
+
+        void PrintAverage(std::ostream& out) const
+        {
+            if (frames == 0)
+                return;
+            out << "Average over " << frames << " frames:";
+            for (unsigned int i = 0; i < COUNTER_COUNT; i++)
+                out << ' ' << GetName((FrameCounter)i) << '=' << (double)total[i] / frames;
+            out << std::endl;
+        }
+
+    private:
+        std::atomic<uint64_t> current[COUNTER_COUNT];
+        uint64_t last[COUNTER_COUNT];
+        uint64_t total[COUNTER_COUNT];
+        unsigned int frames;
+        std::ofstream csv;
+
+        FrameStats() : frames(0)
+        {
+            for (unsigned int i = 0; i < COUNTER_COUNT; i++)
+            {
+                current[i].store(0);
+                last[i] = 0;
+                total[i] = 0;
+            }
+        }
+        FrameStats(const FrameStats&);
+        FrameStats& operator=(const FrameStats&);
+
+        void writeCsvRow()
+        {
+            csv << frames;
+            for (unsigned int i = 0; i < COUNTER_COUNT; i++)
+                csv << ',' << last[i];
+            csv << '\n';
+        }
+};
+
+#ifdef SKANIM_FRAME_STATS
+#define FRAME_STAT_ADD(counter, value) FrameStats::Get().Add(counter, value)
+#else
+#define FRAME_STAT_ADD(counter, value)
+#endif
+
+#endif
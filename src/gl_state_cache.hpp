@@ -0,0 +1,159 @@
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+
+#include <glad/glad.h>
+
+#include "frame_stats.hpp"
+
+// Shadow copy of the GL binding state the draws touch: program, vertex array, the 2D texture
+// of each unit, the sampler uniforms of the program and the uniform buffer ranges. A bind to
+// the object already bound is skipped and counted as redundant. The cache only knows about the
+// binds made through it, so Invalidate it whenever other code may have changed the state.
+
+const unsigned int STATE_CACHE_TEXTURE_UNITS = 16;
+const unsigned int STATE_CACHE_SAMPLERS = 16;
+const unsigned int STATE_CACHE_UNIFORM_BUFFERS = 4;
+
+class GLStateCache
+{
+    public:
+        GLStateCache() { Invalidate(); }
+
+        // forgets every binding, the next bind of each kind goes to GL
+        void Invalidate()
+        {
+            program = UNKNOWN;
+            vertexArray = UNKNOWN;
+            activeUnit = UNKNOWN;
+            for (unsigned int i = 0; i < STATE_CACHE_TEXTURE_UNITS; i++)
+                textures[i] = UNKNOWN;
+            numSamplers = 0;
+            for (unsigned int i = 0; i < STATE_CACHE_UNIFORM_BUFFERS; i++)
+                uniformBuffers[i] = UNKNOWN;
+        }
+
+        void UseProgram(GLuint id)
+        {
+            if (!change(program, id))
+                return;
+            glUseProgram(id);
+            // sampler uniforms are program state
+            numSamplers = 0;
+        }
+
+        void BindVertexArray(GLuint id)
+        {
+            if (change(vertexArray, id))
+                glBindVertexArray(id);
+        }
+
+        void BindTexture(unsigned int unit, GLuint id)
+        {
+            if (unit >= STATE_CACHE_TEXTURE_UNITS)
+            {
+                activeUnit = UNKNOWN;
+                glActiveTexture(GL_TEXTURE0 + unit);
+                glBindTexture(GL_TEXTURE_2D, id);
+                FRAME_STAT_ADD(COUNTER_STATE_CHANGES, 2);
+                return;
+            }
+            if (textures[unit] == id)
+            {
+                FRAME_STAT_ADD(COUNTER_REDUNDANT_BINDS, 1);
+                return;
+            }
+            if (change(activeUnit, unit))
+                glActiveTexture(GL_TEXTURE0 + unit);
+            change(textures[unit], id);
+            glBindTexture(GL_TEXTURE_2D, id);
+        }
+
+        // binds size bytes at offset of buffer to a uniform block binding point
+        void BindUniformBuffer(GLuint binding, GLuint buffer, GLintptr offset, GLsizeiptr size)
+        {
+            if (binding < STATE_CACHE_UNIFORM_BUFFERS)
+            {
+                if (uniformBuffers[binding] == buffer && uniformOffsets[binding] == offset && uniformSizes[binding] == size)
+                {
+                    FRAME_STAT_ADD(COUNTER_REDUNDANT_BINDS, 1);
+                    return;
+                }
+                uniformBuffers[binding] = buffer;
+                uniformOffsets[binding] = offset;
+                uniformSizes[binding] = size;
+            }
+            glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+            FRAME_STAT_ADD(COUNTER_STATE_CHANGES, 1);
+        }
+
+        // points a sampler uniform of the current program at a texture unit
+        void SetSampler(GLint location, GLint unit)
+        {
+            if (location < 0)
+                return;
+            for (unsigned int i = 0; i < numSamplers; i++)
+            {
+                if (samplerLocations[i] != location)
+                    continue;
+                if (samplerUnits[i] == unit)
+                {
+                    FRAME_STAT_ADD(COUNTER_REDUNDANT_BINDS, 1);
+                    return;
+                }
+                samplerUnits[i] = unit;
+                setSampler(location, unit);
+                return;
+            }
+            if (numSamplers < STATE_CACHE_SAMPLERS)
+            {
+                samplerLocations[numSamplers] = location;
+                samplerUnits[numSamplers] = unit;
+                numSamplers++;
+            }
+            setSampler(location, unit);
+        }
+
+        // the defaults the rest of the code expects: no vertex array bound, texture unit 0 active
+        void Reset()
+        {
+            BindVertexArray(0);
+            if (change(activeUnit, 0))
+                glActiveTexture(GL_TEXTURE0);
+        }
+
+    private:
+        static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+        GLuint program;
+        GLuint vertexArray;
+        GLuint activeUnit;
+        GLuint textures[STATE_CACHE_TEXTURE_UNITS];
+        GLint samplerLocations[STATE_CACHE_SAMPLERS];
+        GLint samplerUnits[STATE_CACHE_SAMPLERS];
+        unsigned int numSamplers;
+        GLuint uniformBuffers[STATE_CACHE_UNIFORM_BUFFERS];
+        GLintptr uniformOffsets[STATE_CACHE_UNIFORM_BUFFERS];
+        GLsizeiptr uniformSizes[STATE_CACHE_UNIFORM_BUFFERS];
+
+        // true when value differs from the cached one, which it replaces
+        static bool change(GLuint& cached, GLuint value)
+        {
+            if (cached == value)
+            {
+                FRAME_STAT_ADD(COUNTER_REDUNDANT_BINDS, 1);
+                return false;
+            }
+            cached = value;
+            FRAME_STAT_ADD(COUNTER_STATE_CHANGES, 1);
+            return true;
+        }
+
+        static void setSampler(GLint location, GLint unit)
+        {
+            glUniform1i(location, unit);
+            FRAME_STAT_ADD(COUNTER_UNIFORM_UPLOADS, 1);
+            FRAME_STAT_ADD(COUNTER_BYTES_UPLOADED, sizeof(GLint));
+        }
+};
+
+#endif
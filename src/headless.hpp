@@ -0,0 +1,234 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <glad/glad.h>
+
+#ifdef SKANIM_HAS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+// OpenGL 4.1 core context without a window, created through EGL. Uses a surfaceless display
+// (EGL_MESA_platform_surfaceless) when the driver offers one, so it also runs on machines
+// without any GPU or display server through Mesa's llvmpipe.
+class HeadlessContext
+{
+    public:
+        HeadlessContext() : initialized(false)
+        {
+#ifdef SKANIM_HAS_EGL
+            display = EGL_NO_DISPLAY;
+            context = EGL_NO_CONTEXT;
+            surface = EGL_NO_SURFACE;
+#endif
+        }
+
+        ~HeadlessContext() { Destroy(); }
+
+        bool Init()
+        {
+#ifdef SKANIM_HAS_EGL
+            const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+            PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+            if (getPlatformDisplay && hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless"))
+                display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            if (display == EGL_NO_DISPLAY)
+                display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+            EGLint major, minor;
+            if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+            {
+                std::cout << "ERROR::EGL: Failed to initialize display" << std::endl;
+                return false;
+            }
+            if (!eglBindAPI(EGL_OPENGL_API))
+            {
+                std::cout << "ERROR::EGL: Desktop OpenGL is not supported" << std::endl;
+                return false;
+            }
+
+            bool surfaceless = hasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+            const EGLint configAttributes[] = {
+                EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+                EGL_NONE
+            };
+            EGLConfig config;
+            EGLint numConfigs = 0;
+            if (!eglChooseConfig(display, configAttributes, &config, 1, &numConfigs) || numConfigs == 0)
+            {
+                std::cout << "ERROR::EGL: No suitable config" << std::endl;
+                return false;
+            }
+
+            const EGLint contextAttributes[] = {
+                EGL_CONTEXT_MAJOR_VERSION, 4,
+                EGL_CONTEXT_MINOR_VERSION, 1,
+                EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                EGL_NONE
+            };
+            context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+            if (context == EGL_NO_CONTEXT)
+            {
+                std::cout << "ERROR::EGL: Failed to create an OpenGL 4.1 core context" << std::endl;
+                return false;
+            }
+
+            // everything is rendered into our own framebuffer, the pbuffer only exists to make the context current
+            if (!surfaceless)
+            {
+                const EGLint pbufferAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+                surface = eglCreatePbufferSurface(display, config, pbufferAttributes);
+            }
+            if (!eglMakeCurrent(display, surface, surface, context))
+            {
+                std::cout << "ERROR::EGL: Failed to make the context current" << std::endl;
+                return false;
+            }
+
+            initialized = true;
+            return true;
+#else
+            std::cout << "ERROR::EGL: Built without EGL, headless mode is not available" << std::endl;
+            return false;
+#endif
+        }
+
+        void Destroy()
+        {
+#ifdef SKANIM_HAS_EGL
+            if (display == EGL_NO_DISPLAY)
+                return;
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (surface != EGL_NO_SURFACE)
+                eglDestroySurface(display, surface);
+            if (context != EGL_NO_CONTEXT)
+                eglDestroyContext(display, context);
+            eglTerminate(display);
+            display = EGL_NO_DISPLAY;
+            context = EGL_NO_CONTEXT;
+            surface = EGL_NO_SURFACE;
+#endif
+            initialized = false;
+        }
+
+        // to be handed to gladLoadGLLoader
+        static void* GetProcAddress(const char* name)
+        {
+#ifdef SKANIM_HAS_EGL
+            return (void*)eglGetProcAddress(name);
+#else
+            (void)name;
+            return nullptr;
+#endif
+        }
+
+        bool IsInitialized() const { return initialized; }
+
+    private:
+        bool initialized;
+#ifdef SKANIM_HAS_EGL
+        EGLDisplay display;
+        EGLContext context;
+        EGLSurface surface;
+#endif
+
+        static bool hasExtension(const char* extensions, const char* name)
+        {
+            if (extensions == nullptr)
+                return false;
+            size_t length = std::strlen(name);
+            for (const char* start = extensions; (start = std::strstr(start, name)) != nullptr; start += length)
+                if ((start == extensions || start[-1] == ' ') && (start[length] == ' ' || start[length] == '\0'))
+                    return true;
+            return false;
+        }
+};
+
+// Offscreen color + depth target the headless mode renders into, with a readback buffer
+// allocated once so reading the frame back doesn't allocate
+class Framebuffer
+{
+    public:
+        GLuint ID;
+        int Width, Height;
+
+        Framebuffer() : ID(0), Width(0), Height(0), colorBuffer(0), depthBuffer(0) {}
+
+        bool Create(int width, int height)
+        {
+            Width = width;
+            Height = height;
+            glGenFramebuffers(1, &ID);
+            glBindFramebuffer(GL_FRAMEBUFFER, ID);
+
+            glGenRenderbuffers(1, &colorBuffer);
+            glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+
+            glGenRenderbuffers(1, &depthBuffer);
+            glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+            pixels.resize((size_t)width * height * 4);
+
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            {
+                std::cout << "ERROR::FRAMEBUFFER: Framebuffer is not complete" << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        void Bind() const
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, ID);
+            glViewport(0, 0, Width, Height);
+        }
+
+        // copies the color buffer back to system memory, waiting for the frame to finish
+        const std::vector<unsigned char>& ReadPixels()
+        {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, ID);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glReadPixels(0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+            return pixels;
+        }
+
+        // writes the last read back frame as a binary PPM, flipped so the image is upright
+        bool WritePPM(const char* filename) const
+        {
+            FILE* file = fopen(filename, "wb");
+            if (!file)
+                return false;
+            fprintf(file, "P6\n%d %d\n255\n", Width, Height);
+            for (int y = Height - 1; y >= 0; y--)
+                for (int x = 0; x < Width; x++)
+                    fwrite(&pixels[((size_t)y * Width + x) * 4], 1, 3, file);
+            fclose(file);
+            return true;
+        }
+
+        void Destroy()
+        {
+            glDeleteRenderbuffers(1, &colorBuffer);
+            glDeleteRenderbuffers(1, &depthBuffer);
+            glDeleteFramebuffers(1, &ID);
+            ID = colorBuffer = depthBuffer = 0;
+        }
+
+    private:
+        GLuint colorBuffer, depthBuffer;
+        std::vector<unsigned char> pixels;
+};
+
+#endif
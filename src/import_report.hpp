@@ -0,0 +1,172 @@
+#ifndef IMPORT_REPORT_H
+#define IMPORT_REPORT_H
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "timing.hpp"
+
+// Where the time of one model import goes: wall time of every stage (file read, parse, each
+// post-process step, scene conversion, texture decode, GL upload) and counters of the data
+// that went through them. Stages nest, a stage's time includes the ones indented below it.
+
+struct ImportReport
+{
+    struct Stage
+    {
+        std::string Name;
+        unsigned int Depth;
+        unsigned int Calls;
+        double Milliseconds;
+    };
+
+    struct Counter
+    {
+        std::string Name;
+        uint64_t Value;
+    };
+
+    std::string Asset;
+    // false when the file couldn't be read or parsed, or held no mesh
+    bool Imported;
+    double TotalMilliseconds;
+    // in the order they were first entered
+    std::vector<Stage> Stages;
+    std::vector<Counter> Counters;
+
+    ImportReport() : Imported(false), TotalMilliseconds(0.0), depth(0) {}
+
+    void AddTime(const char* name, unsigned int stageDepth, double milliseconds)
+    {
+        Stage& stage = findStage(name, stageDepth);
+        stage.Calls++;
+        stage.Milliseconds += milliseconds;
+    }
+
+    void AddCount(const char* name, uint64_t value)
+    {
+        for (unsigned int i = 0; i < Counters.size(); i++)
+        {
+            if (Counters[i].Name == name)
+            {
+                Counters[i].Value += value;
+                return;
+            }
+        }
+        Counter counter = { name, value };
+        Counters.push_back(counter);
+    }
+
+    double GetMilliseconds(const std::string& name) const
+    {
+        for (unsigned int i = 0; i < Stages.size(); i++)
+            if (Stages[i].Name == name)
+                return Stages[i].Milliseconds;
+        return 0.0;
+    }
+
+    uint64_t GetCount(const std::string& name) const
+    {
+        for (unsigned int i = 0; i < Counters.size(); i++)
+            if (Counters[i].Name == name)
+                return Counters[i].Value;
+        return 0;
+    }
+
+    void Print(std::ostream& out) const
+    {
+        out << "Import of '" << Asset << "': " << TotalMilliseconds << " ms" << (Imported ? "" : ", FAILED") << std::endl;
+        for (unsigned int i = 0; i < Stages.size(); i++)
+        {
+            const Stage& stage = Stages[i];
+            out << "  " << std::string(stage.Depth * 2, ' ') << stage.Name << ": " << stage.Milliseconds << " ms";
+            if (TotalMilliseconds > 0.0)
+                out << " (" << (int)(stage.Milliseconds / TotalMilliseconds * 100.0 + 0.5) << "%)";
+            if (stage.Calls > 1)
+                out << ", " << stage.Calls << " calls";
+            out << std::endl;
+        }
+        for (unsigned int i = 0; i < Counters.size(); i++)
+            out << "  " << Counters[i].Name << ": " << Counters[i].Value << std::endl;
+    }
+
+    void WriteJson(std::ostream& out) const
+    {
+        out << "{\"asset\":\"" << Asset << "\",\"imported\":" << (Imported ? "true" : "false") << ",\"total_ms\":" << TotalMilliseconds << ",\"stages\":[";
+        for (unsigned int i = 0; i < Stages.size(); i++)
+            out << (i > 0 ? "," : "") << "{\"name\":\"" << Stages[i].Name << "\",\"depth\":" << Stages[i].Depth
+                << ",\"calls\":" << Stages[i].Calls << ",\"ms\":" << Stages[i].Milliseconds << "}";
+        out << "],\"counters\":{";
+        for (unsigned int i = 0; i < Counters.size(); i++)
+            out << (i > 0 ? "," : "") << "\"" << Counters[i].Name << "\":" << Counters[i].Value;
+        out << "}}";
+    }
+
+    // one JSON array holding the report of every asset
+    static bool WriteJson(const std::string& path, const std::vector<ImportReport>& reports)
+    {
+        std::ofstream file(path.c_str());
+        if (!file)
+        {
+            std::cout << "ERROR::IMPORT_REPORT: Failed to write " << path << std::endl;
+            return false;
+        }
+        file << "[\n";
+        for (unsigned int i = 0; i < reports.size(); i++)
+        {
+            reports[i].WriteJson(file);
+            file << (i + 1 < reports.size() ? ",\n" : "\n");
+        }
+        file << "]\n";
+        return true;
+    }
+
+    private:
+        friend class ImportStageTimer;
+
+        // nesting depth of the stages currently being timed
+        unsigned int depth;
+
+        Stage& findStage(const char* name, unsigned int stageDepth)
+        {
+            for (unsigned int i = 0; i < Stages.size(); i++)
+                if (Stages[i].Depth == stageDepth && Stages[i].Name == name)
+                    return Stages[i];
+            Stage stage = { name, stageDepth, 0, 0.0 };
+            Stages.push_back(stage);
+            return Stages.back();
+        }
+};
+
+// Adds the lifetime of the scope to a stage of the report, does nothing without a report
+class ImportStageTimer
+{
+    public:
+        ImportStageTimer(ImportReport* report, const char* name) : report(report), name(name), stageDepth(0)
+        {
+            if (report == nullptr)
+                return;
+            stageDepth = report->depth++;
+            // enter the stage now, so it's listed before the stages nested in it
+            report->findStage(name, stageDepth);
+        }
+
+        ~ImportStageTimer()
+        {
+            if (report == nullptr)
+                return;
+            report->depth--;
+            report->AddTime(name, stageDepth, timer.ElapsedMilliseconds());
+        }
+
+    private:
+        ImportReport* report;
+        const char* name;
+        unsigned int stageDepth;
+        Timer timer;
+};
+
+#endif
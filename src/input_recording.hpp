@@ -0,0 +1,117 @@
+#ifndef INPUT_RECORDING_H
+#define INPUT_RECORDING_H
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Records the actions triggered by the user, tagged with the frame they happened on, and
+// plays them back on the same frames. Together with the benchmark clock, a replayed run
+// renders exactly the same frames as the recorded one.
+
+enum InputAction
+{
+    INPUT_QUIT = 1 << 0,
+    INPUT_NEXT_ANIMATION = 1 << 1,
+    INPUT_TOGGLE_CAPTURE = 1 << 2
+};
+
+struct InputEvent
+{
+    unsigned int Frame;
+    unsigned int Actions; // InputAction flags
+};
+
+class InputRecording
+{
+    public:
+        // events kept by a recording, reserved up front so recording never allocates in the frame loop
+        static const unsigned int MAX_EVENTS = 4096;
+
+        InputRecording() : next(0) {}
+
+        void BeginRecording()
+        {
+            events.clear();
+            events.reserve(MAX_EVENTS);
+        }
+
+        void Record(unsigned int frame, unsigned int actions)
+        {
+            if (actions == 0)
+                return;
+            if (events.size() == MAX_EVENTS)
+            {
+                std::cout << "WARNING::INPUT: Recording full, dropping the input of frame " << frame << std::endl;
+                return;
+            }
+            InputEvent event = { frame, actions };
+            events.push_back(event);
+        }
+
+        // actions recorded for frame, frames must be replayed in increasing order
+        unsigned int Replay(unsigned int frame)
+        {
+            unsigned int actions = 0;
+            while (next < events.size() && events[next].Frame <= frame)
+            {
+                if (events[next].Frame == frame)
+                    actions |= events[next].Actions;
+                next++;
+            }
+            return actions;
+        }
+
+        // text format: one "frame actions" line per event, actions as a bit mask of InputAction
+        bool Save(const std::string& path) const
+        {
+            std::ofstream file(path.c_str());
+            if (!file)
+            {
+                std::cout << "ERROR::INPUT: Failed to write " << path << std::endl;
+                return false;
+            }
+            file << "# skanim input recording: frame actions (1 quit, 2 next animation, 4 toggle capture)\n";
+            for (unsigned int i = 0; i < events.size(); i++)
+                file << events[i].Frame << ' ' << events[i].Actions << '\n';
+            return true;
+        }
+
+        bool Load(const std::string& path)
+        {
+            std::ifstream file(path.c_str());
+            if (!file)
+            {
+                std::cout << "ERROR::INPUT: Failed to read " << path << std::endl;
+                return false;
+            }
+            events.clear();
+            next = 0;
+            std::string line;
+            while (std::getline(file, line))
+            {
+                if (line.empty() || line[0] == '#')
+                    continue;
+                InputEvent event;
+                std::istringstream stream(line);
+                if (!(stream >> event.Frame >> event.Actions))
+                {
+                    std::cout << "ERROR::INPUT: Invalid event '" << line << "' in " << path << std::endl;
+                    return false;
+                }
+                events.push_back(event);
+            }
+            return true;
+        }
+
+        unsigned int GetNumEvents() const { return (unsigned int)events.size(); }
+
+    private:
+        std::vector<InputEvent> events;
+        // next event to replay
+        unsigned int next;
+};
+
+#endif
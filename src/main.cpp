@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
 #include <string>
 #include <iostream>
 
@@ -8,142 +12,643 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "alloc_tracker.hpp"
+#include "frame_pipeline.hpp"
+#include "frame_ring.hpp"
+#include "frame_stats.hpp"
+#include "headless.hpp"
+#include "import_report.hpp"
+#include "input_recording.hpp"
 #include "model.hpp"
+#include "model_loader.hpp"
+#include "profiler.hpp"
 #include "shader.hpp"
-#include "texture.hpp"
+#include "sim_clock.hpp"
+#include "stress_scene.hpp"
+#include "texture_manager.hpp"
+#include "timing.hpp"
 
-static void ProcessInput(GLFWwindow* window);
+static unsigned int PollInput(GLFWwindow* window);
+static void ApplyInput(unsigned int actions, GLFWwindow* window);
 static void FramebufferSizeCallback(GLFWwindow* window, int width, int height);
+static bool ParseArguments(int argc, char** argv);
+static void PrintUsage();
 
-static Model LoadModelFromFilename(const std::string& path);
+// vertical field of view of every projection, in degrees
+const float FIELD_OF_VIEW_Y = 90.0f;
 
 // settings
-const unsigned int WindowWidth  = 800;
-const unsigned int WindowHeight = 600;
+struct AppOptions
+{
+    int WindowWidth;
+    int WindowHeight;
+    // render into an offscreen framebuffer through EGL instead of opening a window
+    bool Headless;
+    // stop after this many frames, 0 runs until the window is closed
+    unsigned int Frames;
+    // read the frame back to system memory every frame (headless only)
+    bool Readback;
+    // PPM file receiving the last frame (headless only)
+    std::string Screenshot;
+    // profile the whole run and write a Chrome trace here at exit
+    std::string TracePath;
+    // time every stage of the model import, printed and/or written as JSON
+    bool PrintImportReport;
+    std::string ImportJsonPath;
+    // renders the stress scene instead of the single model when it lists any asset
+    SceneOptions Scene;
+    // clock driving the animations, headless runs default to the benchmark clock
+    ClockMode Clock;
+    bool ClockSet;
+    double Step;
+    // input recorded to / replayed from these files
+    std::string RecordPath;
+    std::string ReplayPath;
+    // per-frame counters printed every N frames and/or written one row per frame
+    unsigned int StatsInterval;
+    std::string StatsCsvPath;
+    // map the palette ring buffer persistently when the context has buffer storage
+    bool PersistentMapping;
+    // simulate the next stress scene frame on another thread while the current one is drawn. Off by
+    // default: frames are shown one frame late, so the first is blank and the last simulated is never drawn.
+    bool Pipelined;
+    // compare the joint transforms of the stress scene with a full pose evaluation at exit
+    bool CheckJoints;
+
+    AppOptions() : WindowWidth(800), WindowHeight(600), Headless(false), Frames(0), Readback(false), PrintImportReport(false),
+        Clock(ClockMode::RealTime), ClockSet(false), Step(1.0 / 60.0), StatsInterval(0), PersistentMapping(true),
+        Pipelined(false), CheckJoints(false) {}
+};
+
+AppOptions options;
+int framebufferWidth = 0;
+int framebufferHeight = 0;
 
 Model model;
 uint currentAnimation = 0;
 bool animationChanged = false;
+bool profilerKeyPressed = false;
+bool quit = false;
 
-// timing
-float deltaTime = 0.0f; // time between current frame and last frame
-float lastFrame = 0.0f;
+InputRecording input;
 
-int main()
+// the simulation half of a pipelined stress scene frame, run on the pipeline thread
+struct SimulateStressFrame
 {
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
+    StressScene& Scene;
+    glm::mat4 Projection;
+    glm::mat4 View;
+    float TanHalfFovY;
+    float Time;
+    unsigned int Frame;
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    glfwWindowHint(GLFW_COCOA_RETINA_FRAMEBUFFER, GL_FALSE);
-#endif
+    SimulateStressFrame(StressScene& scene, const glm::mat4& projection, float tanHalfFovY, float time, unsigned int frame) :
+        Scene(scene), Projection(projection), View(scene.GetCameraView(frame)), TanHalfFovY(tanHalfFovY), Time(time), Frame(frame) {}
+
+    void operator()() const { Scene.Simulate(Frame, Projection, View, Scene.GetCameraPosition(Frame), TanHalfFovY, Time, Frame); }
+};
 
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(WindowWidth, WindowHeight, "Skeletal Animation", nullptr, nullptr);
-    if (window == nullptr)
+int main(int argc, char** argv)
+{
+    if (!ParseArguments(argc, argv))
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
+        PrintUsage();
         return -1;
     }
-    glfwMakeContextCurrent(window);
-
-    glfwSetFramebufferSizeCallback(window, FramebufferSizeCallback);
+    framebufferWidth = options.WindowWidth;
+    framebufferHeight = options.WindowHeight;
 
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+#ifdef SKANIM_PROFILER
+    // allocate the event buffer now, so starting a capture later doesn't allocate in the frame loop
+    Profiler::Get().Init(1 << 20);
+    Profiler::Get().SetEnabled(!options.TracePath.empty());
+#endif
 
-    // glad: load all OpenGL function pointers
-    // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    GLFWwindow* window = nullptr;
+    HeadlessContext headless;
+    Framebuffer offscreen;
+    if (options.Headless)
     {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        // egl: create a context without any window or display server
+        // -------------------------------------------------------------
+        if (!headless.Init())
+            return -1;
+        if (!gladLoadGLLoader((GLADloadproc)HeadlessContext::GetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+        if (!offscreen.Create(options.WindowWidth, options.WindowHeight))
+            return -1;
+        offscreen.Bind();
+        std::cout << "Headless renderer: " << glGetString(GL_RENDERER) << std::endl;
+    }
+    else
+    {
+        // glfw: initialize and configure
+        // ------------------------------
+        glfwInit();
+
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_COCOA_RETINA_FRAMEBUFFER, GL_FALSE);
+#endif
+
+        // glfw window creation
+        // --------------------
+        window = glfwCreateWindow(options.WindowWidth, options.WindowHeight, "Skeletal Animation", nullptr, nullptr);
+        if (window == nullptr)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+
+        glfwSetFramebufferSizeCallback(window, FramebufferSizeCallback);
+
+        // tell GLFW to capture our mouse
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+        // glad: load all OpenGL function pointers
+        // ---------------------------------------
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
     }
 
     // setup OpenGL
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
+    if (options.PersistentMapping)
+        FrameRing::LoadBufferStorage(options.Headless ? (GLADloadproc)HeadlessContext::GetProcAddress : (GLADloadproc)glfwGetProcAddress);
 
-    model = LoadModelFromFilename("../assets/zombie.fbx");
-    Texture2D texture("../assets/zombie.png", GL_FALSE, GL_CLAMP_TO_EDGE, GL_NEAREST, GL_NEAREST);
     Shader defaultShader("../src/shaders/default.vs", "../src/shaders/default.fs");
+    defaultShader.BindUniformBlock("Bones", BONES_BLOCK_BINDING);
+
+    // either the stress scene or the single model, which is only imported when it is drawn
+    StressScene stressScene;
+    bool stress = !options.Scene.Assets.empty();
+    if (stress && !stressScene.Load(options.Scene))
+        return -1;
+
+    TextureRef texture;
+    // the palette of the single model, one a frame
+    FrameRingBuffer palettes;
+    if (!stress)
+    {
+        ModelLoadOptions loadOptions;
+        loadOptions.Residency = ResidencyPolicy::ReleaseAfterUpload;
+        ImportReport importReport;
+        if (options.PrintImportReport || !options.ImportJsonPath.empty())
+            loadOptions.Report = &importReport;
+        model = LoadModelFromFilename("../assets/zombie.fbx", loadOptions);
+        if (options.PrintImportReport)
+            importReport.Print(std::cout);
+        if (!options.ImportJsonPath.empty())
+            ImportReport::WriteJson(options.ImportJsonPath, std::vector<ImportReport>(1, importReport));
+        texture = TextureRef(TextureManager::Get().Acquire("../assets/zombie.png", GL_CLAMP_TO_EDGE, GL_NEAREST, GL_NEAREST));
+        if (!palettes.Init(GL_UNIFORM_BUFFER, BONES_BLOCK_BYTES, 1))
+            return -1;
+
+        std::cout << "Memory used by ../assets/zombie.fbx:" << std::endl;
+        model.GetMemoryReport().Print(std::cout);
+    }
+    // frames are drawn one frame after they are simulated
+    std::unique_ptr<FramePipeline> pipeline;
+    if (stress && options.Pipelined)
+        pipeline.reset(new FramePipeline());
+
+    // steady-state frames must not touch the heap, checked when built with SKANIM_TRACK_ALLOCATIONS
+    FrameAllocations frameAllocations;
+    bool recording = !options.RecordPath.empty();
+    bool replaying = !options.ReplayPath.empty();
+    if (replaying && !input.Load(options.ReplayPath))
+        return -1;
+    if (recording)
+        input.BeginRecording();
+    if (!options.StatsCsvPath.empty() && !FrameStats::Get().OpenCsv(options.StatsCsvPath))
+        return -1;
+    FrameStats::Get().DiscardCurrent();
+    SimulationClock simulationClock(options.Clock, options.Step);
+    Timer clock;
+    unsigned int frame = 0;
+    // room for the frame times is reserved up front, frames past it are not recorded
+    std::vector<double> frameTimes;
+    frameTimes.reserve(options.Frames > 0 ? options.Frames : 1 << 16);
+    Timer frameTimer;
 
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window))
+    while (!quit && (window ? !glfwWindowShouldClose(window) : frame < options.Frames))
     {
+        frameAllocations.BeginFrame();
+#ifdef SKANIM_PROFILER
+        Profiler::Get().BeginFrame();
+#endif
+        PROFILE_SCOPE("Frame");
+        frameTimer.Reset();
+
         // per-frame time logic
         // --------------------
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        simulationClock.Advance(clock.ElapsedMilliseconds() / 1000.0);
+        float currentFrame = (float)simulationClock.GetTime();
 
         // input
         // -----
-        ProcessInput(window);
+        unsigned int actions = window ? PollInput(window) : 0;
+        // a replay drives the run, only the recorded actions are applied
+        if (replaying)
+            actions = input.Replay(frame);
+        if (recording)
+            input.Record(frame, actions);
+        ApplyInput(actions, window);
 
         // render
         // ------
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // activate texture
-        glActiveTexture(GL_TEXTURE0);
-        texture.Bind();
-
-        // Prepare transformations matrices and uniforms
-        defaultShader.Use();
-        defaultShader.SetMatrix4("projection", glm::perspective(glm::radians(90.0f), static_cast<GLfloat>(WindowWidth) / static_cast<GLfloat>(WindowHeight), 0.1f, 100.0f));
-        defaultShader.SetMatrix4("view", glm::lookAt(glm::vec3(0.0f, 6.0f, 8.0f), glm::vec3(0.0f, 5.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
-        defaultShader.SetMatrix4("model", glm::mat4(1.0f));
-        defaultShader.SetInteger("animated", model.HasAnimations());
-
-        // Set model transformation and render the model
-        model.SetBoneTransformations(defaultShader, currentFrame);
-        model.Draw(defaultShader);
-
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        {
+            // the GPU time of the scene pass, read back a few frames later
+            PROFILE_GPU_SCOPE("Scene");
+            glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            glActiveTexture(GL_TEXTURE0);
+
+            // Prepare transformations matrices and uniforms
+            defaultShader.Use();
+            GLfloat aspect = static_cast<GLfloat>(framebufferWidth) / static_cast<GLfloat>(framebufferHeight);
+            // sizes the instances on screen for the animation LOD
+            float tanHalfFovY = std::tan(glm::radians(FIELD_OF_VIEW_Y) * 0.5f);
+            if (stress && pipeline)
+            {
+                glm::mat4 projection = glm::perspective(glm::radians(FIELD_OF_VIEW_Y), aspect, 0.1f, stressScene.GetFarPlane());
+                SimulateStressFrame simulate(stressScene, projection, tanHalfFovY, currentFrame, frame);
+                stressScene.BeginSimulate(frame);
+                pipeline->Start(simulate);
+                if (frame > 0)
+                    stressScene.Submit(frame - 1, defaultShader);
+                pipeline->Wait();
+            }
+            else if (stress)
+            {
+                glm::mat4 projection = glm::perspective(glm::radians(FIELD_OF_VIEW_Y), aspect, 0.1f, stressScene.GetFarPlane());
+                glm::mat4 view = stressScene.GetCameraView(frame);
+                defaultShader.SetMatrix4("projection", projection);
+                defaultShader.SetMatrix4("view", view);
+                stressScene.Advance(currentFrame);
+                stressScene.Cull(projection * view);
+                stressScene.Update(currentFrame, frame, stressScene.GetCameraPosition(frame), tanHalfFovY);
+                stressScene.Draw(defaultShader, stressScene.GetCameraPosition(frame));
+            }
+            else
+            {
+                defaultShader.SetMatrix4("projection", glm::perspective(glm::radians(FIELD_OF_VIEW_Y), aspect, 0.1f, 100.0f));
+                defaultShader.SetMatrix4("view", glm::lookAt(glm::vec3(0.0f, 6.0f, 8.0f), glm::vec3(0.0f, 5.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+                defaultShader.SetMatrix4("model", glm::mat4(1.0f));
+                defaultShader.SetInteger("animated", model.HasAnimations());
+                TextureManager::Get().Bind(texture.Handle());
+
+                // Set model transformation and render the model
+                palettes.BeginFrame();
+                model.SetBoneTransformations(palettes, currentFrame);
+                palettes.EndWrites();
+                model.Draw(defaultShader);
+                palettes.EndFrame();
+            }
+        }
+
+        if (window)
+        {
+            PROFILE_SCOPE("Swap");
+            // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+            // -------------------------------------------------------------------------------
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+        else if (options.Readback)
+        {
+            PROFILE_SCOPE("Readback");
+            offscreen.ReadPixels();
+        }
+        else
+        {
+            PROFILE_SCOPE("Finish");
+            glFinish();
+        }
+
+        if (frameTimes.size() < frameTimes.capacity())
+            frameTimes.push_back(frameTimer.ElapsedMilliseconds());
+        FrameStats::Get().EndFrame();
+        if (options.StatsInterval > 0 && FrameStats::Get().GetNumFrames() % options.StatsInterval == 0)
+            FrameStats::Get().PrintLast(std::cout);
+        frameAllocations.EndFrame();
+        frame++;
+        if (options.Frames > 0 && frame >= options.Frames && window)
+            glfwSetWindowShouldClose(window, true);
+    }
+    frameAllocations.Report(std::cout);
+
+    double elapsed = clock.ElapsedMilliseconds();
+    std::cout << frame << " frames in " << elapsed << " ms (" << (frame > 0 ? elapsed / frame : 0.0) << " ms/frame)" << std::endl;
+    SampleStats frameStats = SampleStats::Compute(frameTimes);
+    std::cout << "Frame time: min " << frameStats.Min << " ms, avg " << frameStats.Mean << " ms, p99 " << frameStats.P99 << " ms" << std::endl;
+    if (stress)
+        stressScene.PrintStageTimes(std::cout);
+    bool passed = !frameAllocations.Failed();
+    if (stress && options.CheckJoints)
+        passed = stressScene.CheckJointTransforms(std::cout, 1e-4f) && passed;
+    if (pipeline)
+        std::cout << "Pipeline: the render thread waited " << pipeline->GetWaitMilliseconds() / std::max(frame, 1u)
+                  << " ms per frame for the simulation" << std::endl;
+    else if (!stress)
+        palettes.PrintSummary(std::cout, "Palette ring buffer");
+    if (options.StatsInterval > 0 || !options.StatsCsvPath.empty())
+        FrameStats::Get().PrintAverage(std::cout);
+    FrameStats::Get().CloseCsv();
+
+    if (options.Headless && !options.Screenshot.empty())
+    {
+        offscreen.ReadPixels();
+        if (!offscreen.WritePPM(options.Screenshot.c_str()))
+            std::cout << "ERROR::HEADLESS: Failed to write " << options.Screenshot << std::endl;
     }
 
+#ifdef SKANIM_PROFILER
+    if (!options.TracePath.empty())
+        Profiler::Get().WriteChromeTrace(options.TracePath);
+#endif
+    if (recording)
+        input.Save(options.RecordPath);
+
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
+    palettes.Shutdown();
+    stressScene.Shutdown();
+    // the global model outlives the texture registry, drop its references while the registry is alive
+    model = Model();
+    TextureManager::Get().Shutdown();
+#ifdef SKANIM_PROFILER
+    Profiler::Get().Shutdown();
+#endif
 
+    if (options.Headless)
+    {
+        offscreen.Destroy();
+        headless.Destroy();
+    }
+    else
+    {
+        // glfw: terminate, clearing all previously allocated GLFW resources.
+        // ------------------------------------------------------------------
+        glfwTerminate();
+    }
+    return passed ? 0 : 1;
+}
+
+// a whole number greater than zero, or zero when allowed
+static bool ParseCount(const std::string& text, unsigned int& count, bool allowZero)
+{
+    char* end = nullptr;
+    unsigned long value = std::strtoul(text.c_str(), &end, 10);
+    if (end == text.c_str() || *end != '\0' || text[0] == '-' || (value == 0 && !allowZero) || value > 0xFFFFFFFFul)
+        return false;
+    count = (unsigned int)value;
+    return true;
+}
 
-    // glfw: terminate, clearing all previously allocated GLFW resources.
-    // ------------------------------------------------------------------
-    glfwTerminate();
-    return 0;
+// a finite number greater than zero, or zero when allowed
+static bool ParseAmount(const std::string& text, float& amount, bool allowZero)
+{
+    char* end = nullptr;
+    double value = std::strtod(text.c_str(), &end);
+    if (end == text.c_str() || *end != '\0' || !std::isfinite(value) || value < 0.0 || (value == 0.0 && !allowZero) || value > 1e30)
+        return false;
+    amount = (float)value;
+    return true;
+}
+
+static bool ParseArguments(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+        if (arg == "--headless")
+            options.Headless = true;
+        else if (arg == "--readback")
+            options.Readback = true;
+        else if (arg == "--import-report")
+            options.PrintImportReport = true;
+        else if (i + 1 < argc && arg == "--import-json")
+            options.ImportJsonPath = argv[++i];
+        else if (i + 1 < argc && arg == "--scene")
+        {
+            if (!options.Scene.ParseAssets(argv[++i]))
+                return false;
+        }
+        else if (i + 1 < argc && arg == "--layout")
+        {
+            std::string layout(argv[++i]);
+            if (layout != "grid" && layout != "random")
+                return false;
+            options.Scene.Layout = layout == "grid" ? SceneLayout::Grid : SceneLayout::Random;
+        }
+        else if (i + 1 < argc && arg == "--anim-lod")
+        {
+            if (!options.Scene.AnimationLod.Parse(argv[++i]))
+                return false;
+        }
+        else if (i + 1 < argc && arg == "--skeleton-lod")
+        {
+            if (!options.Scene.AnimationLod.ParseSkeleton(argv[++i]))
+                return false;
+        }
+        else if (i + 1 < argc && arg == "--mesh-lod")
+        {
+            if (!options.Scene.AnimationLod.ParseMesh(argv[++i]))
+                return false;
+        }
+        else if (arg == "--no-cull")
+            options.Scene.Cull = false;
+        else if (i + 1 < argc && arg == "--hidden-update")
+        {
+            if (!ParseCount(argv[++i], options.Scene.HiddenUpdateInterval, true))
+                return false;
+        }
+        else if (i + 1 < argc && arg == "--layer")
+        {
+            LayerDesc layer;
+            if (!LayerDesc::Parse(argv[++i], layer))
+                return false;
+            options.Scene.Layers.push_back(layer);
+        }
+        else if (i + 1 < argc && arg == "--pose-cache")
+        {
+            if (!ParseAmount(argv[++i], options.Scene.PoseCacheStep, true))
+                return false;
+        }
+        else if (arg == "--root-motion")
+            options.Scene.RootMotion = true;
+        else if (arg == "--check-joints")
+            options.CheckJoints = true;
+        else if (i + 1 < argc && arg == "--walls")
+        {
+            if (!ParseCount(argv[++i], options.Scene.Walls, true))
+                return false;
+        }
+        else if (arg == "--pipeline")
+            options.Pipelined = true;
+        else if (arg == "--no-persistent-map")
+            options.PersistentMapping = false;
+        else if (arg == "--no-sort-draws")
+            options.Scene.SortDraws = false;
+        else if (arg == "--no-occlusion")
+            options.Scene.Occlusion = false;
+        else if (i + 1 < argc && arg == "--cull-threads")
+        {
+            if (!ParseCount(argv[++i], options.Scene.CullThreads, true) || options.Scene.CullThreads > MAX_CULL_THREADS)
+                return false;
+        }
+        else if (i + 1 < argc && arg == "--spacing")
+        {
+            if (!ParseAmount(argv[++i], options.Scene.Spacing, false))
+                return false;
+        }
+        else if (i + 1 < argc && arg == "--seed")
+        {
+            if (!ParseCount(argv[++i], options.Scene.Seed, true))
+                return false;
+        }
+        else if (i + 1 < argc && arg == "--clock")
+        {
+            std::string clock(argv[++i]);
+            if (clock == "realtime")
+                options.Clock = ClockMode::RealTime;
+            else if (clock == "fixed")
+                options.Clock = ClockMode::FixedStep;
+            else if (clock == "benchmark")
+                options.Clock = ClockMode::Benchmark;
+            else
+                return false;
+            options.ClockSet = true;
+        }
+        else if (i + 1 < argc && arg == "--step")
+            options.Step = std::atof(argv[++i]);
+        else if (i + 1 < argc && arg == "--stats-every")
+        {
+            if (!ParseCount(argv[++i], options.StatsInterval, true))
+                return false;
+        }
+        else if (i + 1 < argc && arg == "--stats-csv")
+            options.StatsCsvPath = argv[++i];
+        else if (i + 1 < argc && arg == "--record")
+            options.RecordPath = argv[++i];
+        else if (i + 1 < argc && arg == "--replay")
+            options.ReplayPath = argv[++i];
+        else if (i + 1 < argc && arg == "--frames")
+        {
+            if (!ParseCount(argv[++i], options.Frames, false))
+                return false;
+        }
+        else if (i + 1 < argc && arg == "--width")
+            options.WindowWidth = std::atoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--height")
+            options.WindowHeight = std::atoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--screenshot")
+            options.Screenshot = argv[++i];
+        else if (i + 1 < argc && arg == "--trace")
+            options.TracePath = argv[++i];
+        else
+            return false;
+    }
+    if (options.Headless && options.Frames == 0)
+        options.Frames = 100;
+    if (options.Headless && !options.ClockSet)
+        options.Clock = ClockMode::Benchmark;
+    return options.WindowWidth > 0 && options.WindowHeight > 0 && options.Step > 0.0;
+}
+
+static void PrintUsage()
+{
+    std::cout << "usage: cpp-gl-skeletal-animation [--width W] [--height H] [--frames N]\n"
+              << "                                 [--headless [--readback] [--screenshot FILE.ppm]]\n"
+              << "                                 [--trace FILE.json] [--import-report] [--import-json FILE.json]\n"
+              << "                                 [--scene zombie=1000,man=500 [--layout grid|random] [--spacing S] [--seed N]\n"
+              << "                                  [--anim-lod off|0.25,0.1,0.04] [--skeleton-lod off|0.2,0.08,0.03]\n"
+              << "                                  [--mesh-lod off|0.15,0.06,0.025] [--no-cull] [--hidden-update N]\n"
+              << "                                  [--layer override|additive,CLIP,JOINT[+JOINT...][,WEIGHT]]... [--root-motion] [--pose-cache SECONDS]\n"
+              << "                                  [--walls N [--no-occlusion]] [--cull-threads N] [--no-sort-draws] [--pipeline] [--check-joints]]\n"
+              << "                                 [--clock realtime|fixed|benchmark] [--step SECONDS] [--record FILE] [--replay FILE]\n"
+              << "                                 [--stats-every N] [--stats-csv FILE] [--no-persistent-map]" << std::endl;
 }
 
 /// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
-static void ProcessInput(GLFWwindow* window)
+static unsigned int PollInput(GLFWwindow* window)
 {
+    unsigned int actions = 0;
     // ESC closes the application
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
+        actions |= INPUT_QUIT;
 
     if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS && !animationChanged)
+    {
+        actions |= INPUT_NEXT_ANIMATION;
+        animationChanged = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_RELEASE)
+        animationChanged = false;
+
+    // F2 starts a profiler capture, pressing it again writes it to skanim_trace.json
+    if (glfwGetKey(window, GLFW_KEY_F2) == GLFW_PRESS && !profilerKeyPressed)
+    {
+        actions |= INPUT_TOGGLE_CAPTURE;
+        profilerKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_F2) == GLFW_RELEASE)
+        profilerKeyPressed = false;
+    return actions;
+}
+
+// reacts to the actions of this frame, whether they were just polled or replayed
+static void ApplyInput(unsigned int actions, GLFWwindow* window)
+{
+    if (actions & INPUT_QUIT)
+    {
+        quit = true;
+        if (window)
+            glfwSetWindowShouldClose(window, true);
+    }
+
+    if (actions & INPUT_NEXT_ANIMATION)
     {
         if (currentAnimation < model.GetNumAnimations() - 1)
             currentAnimation++;
         else
             currentAnimation = 0;
         model.SetAnimation(currentAnimation);
-        animationChanged = true;
     }
-    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_RELEASE)
-        animationChanged = false;
+
+#ifdef SKANIM_PROFILER
+    if (actions & INPUT_TOGGLE_CAPTURE)
+    {
+        Profiler& profiler = Profiler::Get();
+        if (profiler.IsEnabled())
+        {
+            profiler.SetEnabled(false);
+            profiler.WriteChromeTrace("skanim_trace.json");
+        }
+        else
+        {
+            profiler.Clear();
+            profiler.SetEnabled(true);
+        }
+    }
+#endif
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -153,24 +658,10 @@ void FramebufferSizeCallback(GLFWwindow* /* window */, int width, int height)
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
-}
-
-
-Model LoadModelFromFilename(const std::string& path)
-{
-    Model model;
-    // read file via ASSIMP
-    Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(path, aiProcessPreset_TargetRealtime_Fast | aiProcess_GlobalScale | aiProcess_LimitBoneWeights);
-    // check for errors
-    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    if (width > 0 && height > 0)
     {
-        std::cout << "ERROR::ASSIMP: " << importer.GetErrorString() << std::endl;
-    }
-    else {
-        // retrieve the directory path of the filepath
-        model.SetDirectory(path.substr(0, path.find_last_of('/')));
-        model.InitFromScene(importer.GetOrphanedScene());
+        framebufferWidth = width;
+        framebufferHeight = height;
     }
-    return model;
-}
\ No newline at end of file
+}
+
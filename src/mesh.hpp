@@ -1,7 +1,9 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <algorithm>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <glad/glad.h>
@@ -10,9 +12,16 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <assimp/matrix4x4.h>
 
+#include "frame_stats.hpp"
+#include "gl_state_cache.hpp"
 #include "shader.hpp"
 
 const unsigned int NUM_BONES_PER_VERTEX = 4;
+// the bone palette uniform block of the default shader: its binding point, and its size for
+// MAX_BONES matrices
+const unsigned int MAX_BONES = 100;
+const GLuint BONES_BLOCK_BINDING = 0;
+const GLsizeiptr BONES_BLOCK_BYTES = MAX_BONES * sizeof(glm::mat4);
 
 struct Vertex
 {
@@ -23,6 +32,48 @@ struct Vertex
     glm::vec4 BoneWeights;
 };
 
+// What a mesh keeps in system memory once its buffers have been uploaded to the GPU
+enum class ResidencyPolicy
+{
+    KeepCPUData,        // keep every vertex and index
+    ReleaseAfterUpload, // GPU copy only
+    KeepSkinningData    // only what CPU skinning or collision needs: positions, bone influences and indices
+};
+
+// levels of detail generated at import: the full mesh and up to three simplified index buffers
+const unsigned int MESH_LOD_LEVELS = 4;
+
+// range of the index buffer drawn at one level of detail, every level indexes the same vertex buffer
+struct MeshLod
+{
+    unsigned int Offset;
+    unsigned int Count;
+
+    MeshLod(unsigned int offset = 0, unsigned int count = 0) : Offset(offset), Count(count) {}
+};
+
+struct SkinningData
+{
+    std::vector<glm::vec3> Positions;
+    std::vector<glm::ivec4> BoneIDs;
+    std::vector<glm::vec4> BoneWeights;
+};
+
+struct MemoryUsage
+{
+    size_t CPUBytes;
+    size_t GPUBytes;
+
+    MemoryUsage(size_t cpuBytes = 0, size_t gpuBytes = 0) : CPUBytes(cpuBytes), GPUBytes(gpuBytes) {}
+
+    MemoryUsage& operator+=(const MemoryUsage& other)
+    {
+        CPUBytes += other.CPUBytes;
+        GPUBytes += other.GPUBytes;
+        return *this;
+    }
+};
+
 struct Texture
 {
     unsigned int ID;
@@ -33,59 +84,183 @@ struct Texture
 class Mesh
 {
     public:
-        Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures) :
-            vertices(vertices),
-            indices(indices),
-            textures(textures)
+        std::string Name;
+
+        // without upload only the CPU side is built, which doesn't need a GL context (tools, benchmarks).
+        // lods are ranges of indices, LOD 0 first; without them the whole index buffer is the only level.
+        Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, const std::string& name = "", bool upload = true,
+            std::vector<MeshLod> lods = std::vector<MeshLod>()) :
+            Name(name),
+            vertices(std::move(vertices)),
+            indices(std::move(indices)),
+            textures(std::move(textures)),
+            samplerProgram(0),
+            lods(std::move(lods))
         {
+            if (this->lods.empty())
+                this->lods.push_back(MeshLod(0, (unsigned int)this->indices.size()));
+            vertexCount = (unsigned int)this->vertices.size();
+            indexCount = this->lods[0].Count;
+            // resolve the sampler names once, so drawing doesn't have to build strings every frame
+            setupSamplerNames();
             // now that we have all the required data, set the vertex buffers and its attribute pointers.
-            setupMesh();
+            VAO = VBO = EBO = 0;
+            if (upload)
+                setupMesh();
         }
-        ~Mesh() {}
 
-        void Draw(Shader shader)
+        // lod is clamped to the levels the mesh has
+        void Draw(const Shader& shader, unsigned int lod = 0) const
         {
+            const MeshLod& range = lods[std::min(lod, (unsigned int)lods.size() - 1)];
+
             // bind appropriate textures
-            unsigned int diffuseNr  = 1;
-            unsigned int specularNr = 1;
-            unsigned int normalNr   = 1;
-            unsigned int emissionNr = 1;
             for (unsigned int i = 0; i < textures.size(); i++)
             {
                 glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-                // retrieve texture number (the N in diffuse_textureN)
-                std::string number;
-                std::string name = textures[i].Type;
-                if(name == "texture_diffuse")
-                    number = std::to_string(diffuseNr++); // transfer unsigned int to stream
-                else if(name == "texture_specular")
-                    number = std::to_string(specularNr++);
-                else if (name == "texture_normal")
-                    number = std::to_string(normalNr++);
-                else if (name == "texture_emission")
-                    number = std::to_string(emissionNr++);
-
                 // now set the sampler to the correct texture unit
-                glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+                glUniform1i(getSamplerLocation(shader, i), i);
                 // and finally bind the texture
                 glBindTexture(GL_TEXTURE_2D, textures[i].ID);
             }
 
             // draw mesh
             glBindVertexArray(VAO);
-            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+            glDrawElements(GL_TRIANGLES, range.Count, GL_UNSIGNED_INT, (void*)(range.Offset * sizeof(unsigned int)));
             glBindVertexArray(0);
 
             // always good practice to set everything back to defaults once configured.
             glActiveTexture(GL_TEXTURE0);
+
+            // two binds per texture, the VAO bind/unbind and the texture unit reset
+            FRAME_STAT_ADD(COUNTER_DRAW_CALLS, 1);
+            FRAME_STAT_ADD(COUNTER_TRIANGLES, range.Count / 3);
+            FRAME_STAT_ADD(COUNTER_STATE_CHANGES, textures.size() * 2 + 3);
+            FRAME_STAT_ADD(COUNTER_UNIFORM_UPLOADS, textures.size());
+            FRAME_STAT_ADD(COUNTER_BYTES_UPLOADED, textures.size() * sizeof(GLint));
+        }
+
+        // the same draw through a state cache, which skips the binds already in place. The vertex
+        // array stays bound for the next draw, GLStateCache::Reset unbinds it.
+        void Draw(const Shader& shader, unsigned int lod, GLStateCache& state) const
+        {
+            const MeshLod& range = lods[std::min(lod, (unsigned int)lods.size() - 1)];
+            for (unsigned int i = 0; i < textures.size(); i++)
+            {
+                state.SetSampler(getSamplerLocation(shader, i), i);
+                state.BindTexture(i, textures[i].ID);
+            }
+            state.BindVertexArray(VAO);
+            glDrawElements(GL_TRIANGLES, range.Count, GL_UNSIGNED_INT, (void*)(range.Offset * sizeof(unsigned int)));
+
+            FRAME_STAT_ADD(COUNTER_DRAW_CALLS, 1);
+            FRAME_STAT_ADD(COUNTER_TRIANGLES, range.Count / 3);
+        }
+
+        // drops the CPU copies the policy doesn't need, the GPU buffers are left untouched
+        void ApplyResidency(ResidencyPolicy policy)
+        {
+            if (policy == ResidencyPolicy::KeepCPUData)
+                return;
+
+            if (policy == ResidencyPolicy::KeepSkinningData)
+            {
+                skinning.Positions.resize(vertices.size());
+                skinning.BoneIDs.resize(vertices.size());
+                skinning.BoneWeights.resize(vertices.size());
+                for (unsigned int i = 0; i < vertices.size(); i++)
+                {
+                    skinning.Positions[i] = vertices[i].Position;
+                    skinning.BoneIDs[i] = vertices[i].BoneIDs;
+                    skinning.BoneWeights[i] = vertices[i].BoneWeights;
+                }
+            }
+            else
+                std::vector<unsigned int>().swap(indices);
+            std::vector<Vertex>().swap(vertices);
+        }
+
+        const std::vector<Vertex>& GetVertices() const { return vertices; }
+        // every level of detail, LOD 0 (GetIndexCount indices) first
+        const std::vector<unsigned int>& GetIndices() const { return indices; }
+        const std::vector<MeshLod>& GetLods() const { return lods; }
+        const std::vector<Texture>& GetTextures() const { return textures; }
+        GLuint GetVertexArray() const { return VAO; }
+        const SkinningData& GetSkinningData() const { return skinning; }
+        unsigned int GetVertexCount() const { return vertexCount; }
+        // indices of the full resolution mesh
+        unsigned int GetIndexCount() const { return indexCount; }
+
+        // bytes held in system memory by this mesh and bytes allocated for its GPU buffers
+        MemoryUsage GetMemoryUsage() const
+        {
+            MemoryUsage usage;
+            usage.CPUBytes = sizeof(Mesh) + Name.capacity()
+                + vertices.capacity() * sizeof(Vertex)
+                + indices.capacity() * sizeof(unsigned int)
+                + textures.capacity() * sizeof(Texture)
+                + samplerNames.capacity() * sizeof(std::string)
+                + samplerLocations.capacity() * sizeof(GLint)
+                + lods.capacity() * sizeof(MeshLod)
+                + skinning.Positions.capacity() * sizeof(glm::vec3)
+                + skinning.BoneIDs.capacity() * sizeof(glm::ivec4)
+                + skinning.BoneWeights.capacity() * sizeof(glm::vec4);
+            for (unsigned int i = 0; i < textures.size(); i++)
+                usage.CPUBytes += textures[i].Type.capacity() + textures[i].Path.capacity() + samplerNames[i].capacity();
+            if (VAO != 0)
+                usage.GPUBytes = vertexCount * sizeof(Vertex) + (size_t)(lods.back().Offset + lods.back().Count) * sizeof(unsigned int);
+            return usage;
         }
 
     private:
         std::vector<Vertex> vertices;
         std::vector<unsigned int> indices;
         std::vector<Texture> textures;
+        // sampler uniform of each texture (diffuse_textureN, ...)
+        std::vector<std::string> samplerNames;
+        // their locations in samplerProgram, looked up again when the mesh is drawn with another program
+        mutable GLuint samplerProgram;
+        mutable std::vector<GLint> samplerLocations;
+        std::vector<MeshLod> lods;
+        SkinningData skinning;
+        unsigned int vertexCount, indexCount;
         unsigned int VAO, VBO, EBO;
 
+        void setupSamplerNames()
+        {
+            unsigned int diffuseNr  = 1;
+            unsigned int specularNr = 1;
+            unsigned int normalNr   = 1;
+            unsigned int emissionNr = 1;
+            for (unsigned int i = 0; i < textures.size(); i++)
+            {
+                // retrieve texture number (the N in diffuse_textureN)
+                std::string number;
+                std::string name = textures[i].Type;
+                if(name == "texture_diffuse")
+                    number = std::to_string(diffuseNr++); // transfer unsigned int to stream
+                else if(name == "texture_specular")
+                    number = std::to_string(specularNr++);
+                else if (name == "texture_normal")
+                    number = std::to_string(normalNr++);
+                else if (name == "texture_emission")
+                    number = std::to_string(emissionNr++);
+                samplerNames.push_back(name + number);
+            }
+        }
+
+        GLint getSamplerLocation(const Shader& shader, unsigned int texture) const
+        {
+            if (samplerProgram != shader.ID || samplerLocations.size() != samplerNames.size())
+            {
+                samplerLocations.resize(samplerNames.size());
+                for (unsigned int i = 0; i < samplerNames.size(); i++)
+                    samplerLocations[i] = glGetUniformLocation(shader.ID, samplerNames[i].c_str());
+                samplerProgram = shader.ID;
+            }
+            return samplerLocations[texture];
+        }
+
         // initializes all the buffer objects/arrays
         void setupMesh()
         {
@@ -104,6 +279,7 @@ class Mesh
 
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
             glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+            FRAME_STAT_ADD(COUNTER_BYTES_UPLOADED, vertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int));
 
             // set the vertex attribute pointers
             // vertex Positions
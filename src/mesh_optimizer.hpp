@@ -0,0 +1,411 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh.hpp"
+
+// Import-time mesh processing: runs on the CPU copies before they are uploaded to the GPU.
+
+struct WeldStats
+{
+    unsigned int VerticesIn;
+    unsigned int VerticesOut;
+
+    WeldStats() : VerticesIn(0), VerticesOut(0) {}
+
+    float Reduction() const { return VerticesIn > 0 ? 1.0f - (float)VerticesOut / (float)VerticesIn : 0.0f; }
+};
+
+namespace MeshOptimizer
+{
+    // number of floats compared per vertex: position, normal, uv, weights
+    const unsigned int WELD_FLOATS = 3 + 3 + 2 + NUM_BONES_PER_VERTEX;
+    const unsigned int WELD_NONE = 0xFFFFFFFF;
+
+    inline void weldAttributes(const Vertex& vertex, float* out, int* ids)
+    {
+        out[0] = vertex.Position.x;  out[1] = vertex.Position.y;  out[2] = vertex.Position.z;
+        out[3] = vertex.Normal.x;    out[4] = vertex.Normal.y;    out[5] = vertex.Normal.z;
+        out[6] = vertex.TexCoords.x; out[7] = vertex.TexCoords.y;
+        for (unsigned int i = 0; i < NUM_BONES_PER_VERTEX; i++)
+        {
+            out[8 + i] = vertex.BoneWeights[i];
+            // the id of an unused influence slot is meaningless, don't let it split vertices
+            ids[i] = vertex.BoneWeights[i] != 0.0f ? vertex.BoneIDs[i] : -1;
+        }
+    }
+
+    inline uint64_t hashCombine(uint64_t hash, uint64_t value)
+    {
+        hash ^= value;
+        hash *= 1099511628211ULL;
+        return hash;
+    }
+
+    // hashes the vertex snapped to a grid of the given tolerance, so exact duplicates always collide
+    // and near-exact ones do unless they straddle a grid cell boundary.
+    inline uint64_t hashVertex(const float* attributes, const int* ids, float tolerance)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned int i = 0; i < WELD_FLOATS; i++)
+        {
+            int64_t quantized;
+            if (tolerance > 0.0f)
+                quantized = (int64_t)std::floor(attributes[i] / tolerance + 0.5f);
+            else
+            {
+                // exact mode: hash the bits, with -0 folded onto +0
+                float value = attributes[i] == 0.0f ? 0.0f : attributes[i];
+                uint32_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                quantized = bits;
+            }
+            hash = hashCombine(hash, (uint64_t)quantized);
+        }
+        for (unsigned int i = 0; i < NUM_BONES_PER_VERTEX; i++)
+            hash = hashCombine(hash, (uint64_t)(uint32_t)ids[i]);
+        return hash;
+    }
+
+    inline bool sameVertex(const float* a, const int* aIds, const float* b, const int* bIds, float tolerance)
+    {
+        for (unsigned int i = 0; i < NUM_BONES_PER_VERTEX; i++)
+            if (aIds[i] != bIds[i])
+                return false;
+        for (unsigned int i = 0; i < WELD_FLOATS; i++)
+            if (std::fabs(a[i] - b[i]) > tolerance)
+                return false;
+        return true;
+    }
+
+    // Merges vertices whose full attribute set (position, normal, uv, bone ids and weights) is equal
+    // within tolerance, compacts the vertex array and remaps the indices to the surviving vertices.
+    inline WeldStats WeldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, float tolerance)
+    {
+        WeldStats stats;
+        stats.VerticesIn = (unsigned int)vertices.size();
+
+        std::vector<unsigned int> remap(vertices.size());
+        std::vector<float> attributes(vertices.size() * WELD_FLOATS);
+        std::vector<int> ids(vertices.size() * NUM_BONES_PER_VERTEX);
+        // first welded vertex for each hash, further ones with the same hash are chained through next
+        std::unordered_map<uint64_t, unsigned int> buckets;
+        buckets.reserve(vertices.size());
+        std::vector<unsigned int> next;
+        next.reserve(vertices.size());
+
+        unsigned int unique = 0;
+        for (unsigned int i = 0; i < vertices.size(); i++)
+        {
+            float* attribute = &attributes[i * WELD_FLOATS];
+            int* id = &ids[i * NUM_BONES_PER_VERTEX];
+            weldAttributes(vertices[i], attribute, id);
+            uint64_t hash = hashVertex(attribute, id, tolerance);
+
+            std::unordered_map<uint64_t, unsigned int>::iterator bucket = buckets.find(hash);
+            unsigned int match = WELD_NONE;
+            if (bucket != buckets.end())
+            {
+                for (unsigned int candidate = bucket->second; candidate != WELD_NONE; candidate = next[candidate])
+                {
+                    if (sameVertex(attribute, id, &attributes[candidate * WELD_FLOATS], &ids[candidate * NUM_BONES_PER_VERTEX], tolerance))
+                    {
+                        match = candidate;
+                        break;
+                    }
+                }
+            }
+
+            if (match != WELD_NONE)
+            {
+                remap[i] = remap[match];
+                continue;
+            }
+
+            // i becomes the representative of a new welded vertex
+            remap[i] = unique;
+            vertices[unique] = vertices[i];
+            unique++;
+            next.resize(i + 1, WELD_NONE);
+            if (bucket != buckets.end())
+            {
+                next[i] = bucket->second;
+                bucket->second = i;
+            }
+            else
+                buckets[hash] = i;
+        }
+
+        vertices.resize(unique);
+        for (unsigned int i = 0; i < indices.size(); i++)
+            indices[i] = remap[indices[i]];
+
+        stats.VerticesOut = unique;
+        return stats;
+    }
+
+    // error quadric: sum of the squared distances to a set of planes, as the 10 unique
+    // coefficients of the symmetric 4x4 matrix (xx xy xz xw yy yz yw zz zw ww)
+    struct Quadric
+    {
+        double A[10];
+
+        Quadric() { for (unsigned int i = 0; i < 10; i++) A[i] = 0.0; }
+
+        void AddPlane(const glm::vec3& normal, float distance)
+        {
+            double n[4] = { normal.x, normal.y, normal.z, distance };
+            unsigned int k = 0;
+            for (unsigned int i = 0; i < 4; i++)
+                for (unsigned int j = i; j < 4; j++)
+                    A[k++] += n[i] * n[j];
+        }
+
+        Quadric& operator+=(const Quadric& other)
+        {
+            for (unsigned int i = 0; i < 10; i++)
+                A[i] += other.A[i];
+            return *this;
+        }
+
+        double Evaluate(const glm::vec3& p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            return A[0] * x * x + 2.0 * A[1] * x * y + 2.0 * A[2] * x * z + 2.0 * A[3] * x
+                 + A[4] * y * y + 2.0 * A[5] * y * z + 2.0 * A[6] * y
+                 + A[7] * z * z + 2.0 * A[8] * z
+                 + A[9];
+        }
+    };
+
+    // cost of collapsing across a change of bone influences, times the squared edge length,
+    // so the vertices where the skin changes bone survive and the mesh still deforms the same
+    const float SIMPLIFY_BONE_WEIGHT_PENALTY = 4.0f;
+
+    inline float boneWeight(const Vertex& vertex, int bone)
+    {
+        float weight = 0.0f;
+        for (unsigned int i = 0; i < NUM_BONES_PER_VERTEX; i++)
+            if (vertex.BoneWeights[i] > 0.0f && vertex.BoneIDs[i] == bone)
+                weight += vertex.BoneWeights[i];
+        return weight;
+    }
+
+    // half the L1 distance between two sets of bone influences: 0 when equal, 1 when disjoint
+    inline float boneWeightDifference(const Vertex& a, const Vertex& b)
+    {
+        float difference = 0.0f;
+        for (unsigned int i = 0; i < NUM_BONES_PER_VERTEX; i++)
+        {
+            if (a.BoneWeights[i] > 0.0f)
+                difference += std::fabs(a.BoneWeights[i] - boneWeight(b, a.BoneIDs[i]));
+            if (b.BoneWeights[i] > 0.0f && boneWeight(a, b.BoneIDs[i]) == 0.0f)
+                difference += b.BoneWeights[i];
+        }
+        return difference * 0.5f;
+    }
+
+    inline glm::vec3 triangleNormal(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2)
+    {
+        return glm::cross(p1 - p0, p2 - p0);
+    }
+
+    struct Collapse
+    {
+        float Cost;
+        unsigned int From;
+        unsigned int To;
+    };
+
+    inline bool cheaper(const Collapse& a, const Collapse& b) { return a.Cost < b.Cost; }
+
+    // Quadric error simplification of an index buffer towards targetIndexCount. Edges are collapsed
+    // onto one of their existing vertices, so the result indexes the same vertex buffer. Vertices on
+    // a UV or normal seam (several vertices at one position) and on open borders never move.
+    inline std::vector<unsigned int> SimplifyIndices(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, size_t targetIndexCount,
+        float boneWeightPenalty = SIMPLIFY_BONE_WEIGHT_PENALTY)
+    {
+        std::vector<unsigned int> result(indices);
+        unsigned int vertexCount = (unsigned int)vertices.size();
+
+        // vertices sharing a position are seams, an edge used by one triangle (or more than two) is a border
+        std::vector<unsigned int> position(vertexCount);
+        std::vector<unsigned int> shared(vertexCount, 0);
+        std::unordered_map<uint64_t, unsigned int> positions;
+        positions.reserve(vertexCount);
+        for (unsigned int i = 0; i < vertexCount; i++)
+        {
+            const glm::vec3& p = vertices[i].Position;
+            uint32_t bits[3];
+            std::memcpy(bits, &p, sizeof(bits));
+            uint64_t hash = hashCombine(hashCombine(hashCombine(14695981039346656037ULL, bits[0]), bits[1]), bits[2]);
+            std::unordered_map<uint64_t, unsigned int>::iterator it = positions.find(hash);
+            if (it != positions.end() && vertices[it->second].Position == p)
+                position[i] = it->second;
+            else
+            {
+                position[i] = i;
+                if (it == positions.end())
+                    positions[hash] = i;
+            }
+            shared[position[i]]++;
+        }
+        std::vector<unsigned char> locked(vertexCount, 0);
+        for (unsigned int i = 0; i < vertexCount; i++)
+            locked[i] = shared[position[i]] > 1;
+
+        std::unordered_map<uint64_t, unsigned int> edges;
+        edges.reserve(result.size());
+        for (unsigned int i = 0; i < result.size(); i++)
+        {
+            unsigned int a = position[result[i]], b = position[result[i - i % 3 + (i + 1) % 3]];
+            edges[((uint64_t)std::min(a, b) << 32) | std::max(a, b)]++;
+        }
+        for (unsigned int i = 0; i < result.size(); i++)
+        {
+            unsigned int a = result[i], b = result[i - i % 3 + (i + 1) % 3];
+            unsigned int pa = position[a], pb = position[b];
+            if (edges[((uint64_t)std::min(pa, pb) << 32) | std::max(pa, pb)] != 2)
+                locked[a] = locked[b] = 1;
+        }
+
+        std::vector<Quadric> quadrics(vertexCount);
+        for (unsigned int i = 0; i + 2 < result.size(); i += 3)
+        {
+            const glm::vec3& p0 = vertices[result[i]].Position;
+            glm::vec3 normal = triangleNormal(p0, vertices[result[i + 1]].Position, vertices[result[i + 2]].Position);
+            float length = glm::length(normal);
+            if (length == 0.0f)
+                continue;
+            normal /= length;
+            for (unsigned int k = 0; k < 3; k++)
+                quadrics[result[i + k]].AddPlane(normal, -glm::dot(normal, p0));
+        }
+
+        // every pass collapses the cheapest edges whose neighbourhood is still untouched, so the
+        // adjacency built at the start of the pass stays valid for the vertices it looks at
+        std::vector<unsigned int> firstTriangle(vertexCount + 1), triangles, remap(vertexCount);
+        std::vector<unsigned char> touched(vertexCount);
+        std::vector<Collapse> collapses;
+        while (result.size() > targetIndexCount)
+        {
+            std::fill(firstTriangle.begin(), firstTriangle.end(), 0);
+            for (unsigned int i = 0; i < result.size(); i++)
+                firstTriangle[result[i] + 1]++;
+            for (unsigned int i = 0; i < vertexCount; i++)
+                firstTriangle[i + 1] += firstTriangle[i];
+            triangles.resize(result.size());
+            std::vector<unsigned int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+            for (unsigned int i = 0; i < result.size(); i++)
+                triangles[filled[result[i]]++] = i / 3;
+
+            collapses.clear();
+            for (unsigned int i = 0; i < result.size(); i++)
+            {
+                unsigned int a = result[i], b = result[i - i % 3 + (i + 1) % 3];
+                for (unsigned int direction = 0; direction < 2; direction++)
+                {
+                    unsigned int from = direction == 0 ? a : b, to = direction == 0 ? b : a;
+                    if (locked[from])
+                        continue;
+                    Quadric quadric = quadrics[from];
+                    quadric += quadrics[to];
+                    glm::vec3 edge = vertices[to].Position - vertices[from].Position;
+                    float cost = (float)quadric.Evaluate(vertices[to].Position)
+                        + boneWeightPenalty * boneWeightDifference(vertices[from], vertices[to]) * glm::dot(edge, edge);
+                    Collapse collapse = { cost, from, to };
+                    collapses.push_back(collapse);
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), cheaper);
+
+            for (unsigned int i = 0; i < vertexCount; i++)
+                remap[i] = i;
+            std::fill(touched.begin(), touched.end(), 0);
+            size_t removed = 0, excess = result.size() - targetIndexCount;
+            unsigned int collapsed = 0;
+            for (unsigned int c = 0; c < collapses.size() && removed < excess; c++)
+            {
+                unsigned int from = collapses[c].From, to = collapses[c].To;
+                if (touched[from] || touched[to])
+                    continue;
+
+                // reject the collapse if a triangle around from would flip over
+                bool flips = false;
+                unsigned int degenerate = 0;
+                for (unsigned int t = firstTriangle[from]; t < firstTriangle[from + 1] && !flips; t++)
+                {
+                    const unsigned int* triangle = &result[triangles[t] * 3];
+                    if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+                    {
+                        degenerate++;
+                        continue;
+                    }
+                    glm::vec3 p[3], q[3];
+                    for (unsigned int k = 0; k < 3; k++)
+                    {
+                        p[k] = vertices[triangle[k]].Position;
+                        q[k] = triangle[k] == from ? vertices[to].Position : p[k];
+                    }
+                    flips = glm::dot(triangleNormal(p[0], p[1], p[2]), triangleNormal(q[0], q[1], q[2])) <= 0.0f;
+                }
+                if (flips)
+                    continue;
+
+                remap[from] = to;
+                quadrics[to] += quadrics[from];
+                for (unsigned int t = firstTriangle[from]; t < firstTriangle[from + 1]; t++)
+                    for (unsigned int k = 0; k < 3; k++)
+                        touched[result[triangles[t] * 3 + k]] = 1;
+                removed += degenerate * 3;
+                collapsed++;
+            }
+            if (collapsed == 0)
+                break;
+
+            // move the collapsed corners and drop the triangles that became degenerate
+            unsigned int kept = 0;
+            for (unsigned int i = 0; i + 2 < result.size(); i += 3)
+            {
+                unsigned int a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+                if (a == b || b == c || a == c)
+                    continue;
+                result[kept++] = a;
+                result[kept++] = b;
+                result[kept++] = c;
+            }
+            result.resize(kept);
+        }
+        return result;
+    }
+
+    // Appends up to levels simplified copies of the index buffer, each with about half the
+    // triangles of the one before, and returns the range of every level (the original first).
+    // Simplification stops early once a level can't get meaningfully smaller.
+    inline std::vector<MeshLod> GenerateLods(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, unsigned int levels)
+    {
+        std::vector<MeshLod> lods(1, MeshLod(0, (unsigned int)indices.size()));
+        std::vector<unsigned int> source(indices);
+        for (unsigned int level = 1; level <= levels; level++)
+        {
+            size_t target = (size_t)(lods[0].Count >> level) / 3 * 3;
+            std::vector<unsigned int> simplified = SimplifyIndices(vertices, source, target);
+            if (simplified.empty() || simplified.size() * 10 > source.size() * 9)
+                break;
+            lods.push_back(MeshLod((unsigned int)indices.size(), (unsigned int)simplified.size()));
+            indices.insert(indices.end(), simplified.begin(), simplified.end());
+            source.swap(simplified);
+        }
+        return lods;
+    }
+}
+
+#endif
@@ -7,6 +7,8 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <cstring>
 
 #include <glad/glad.h>
 
@@ -14,14 +16,19 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/quaternion.hpp>
 
-#include <stb_image.h>
-
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "animation.hpp"
+#include "frame_ring.hpp"
+#include "import_report.hpp"
 #include "mesh.hpp"
+#include "mesh_optimizer.hpp"
+#include "profiler.hpp"
+#include "root_motion.hpp"
 #include "shader.hpp"
+#include "texture_manager.hpp"
 
 // For converting between ASSIMP and glm
 static inline glm::vec3 vec3Convert(const aiVector3D& vector) { return glm::vec3(vector.x, vector.y, vector.z); }
@@ -30,14 +37,50 @@ static inline glm::quat quatConvert(const aiQuaternion& quaternion) { return glm
 static inline glm::mat4 mat4Convert(const aiMatrix4x4& matrix) { return glm::transpose(glm::make_mat4(&matrix.a1)); }
 static inline glm::mat4 mat4Convert(const aiMatrix3x3& matrix) { return glm::transpose(glm::make_mat3(&matrix.a1)); }
 
-unsigned int TextureFromFile(const char* filename, const std::string& directory, bool gamma = false);
+// Memory held by a model, broken down per mesh, texture and animation clip
+struct ModelMemoryReport
+{
+    struct Entry
+    {
+        std::string Name;
+        MemoryUsage Usage;
+
+        Entry(const std::string& name, const MemoryUsage& usage) : Name(name), Usage(usage) {}
+    };
+
+    std::vector<Entry> Meshes;
+    // textures are shared through the TextureManager, so they can be counted by several models
+    std::vector<Entry> Textures;
+    std::vector<Entry> Clips;
+    MemoryUsage Skeleton;
+    MemoryUsage Total;
+
+    void Print(std::ostream& out) const
+    {
+        printEntries(out, "mesh", Meshes);
+        printEntries(out, "texture", Textures);
+        printEntries(out, "clip", Clips);
+        out << "  skeleton: cpu " << Skeleton.CPUBytes << " B" << std::endl;
+        out << "  total: cpu " << Total.CPUBytes << " B, gpu " << Total.GPUBytes << " B" << std::endl;
+    }
+
+    private:
+        static void printEntries(std::ostream& out, const char* kind, const std::vector<Entry>& entries)
+        {
+            for (unsigned int i = 0; i < entries.size(); i++)
+                out << "  " << kind << " '" << entries[i].Name << "': cpu " << entries[i].Usage.CPUBytes
+                    << " B, gpu " << entries[i].Usage.GPUBytes << " B" << std::endl;
+        }
+};
 
 class Model
 {
     public:
-        Model() : animDuration(0.0), currentAnimation(0), bonesCount(0)
+        Model() : currentAnimation(0), bonesCount(0), weldTolerance(1e-5f), residency(ResidencyPolicy::KeepCPUData), uploadToGPU(true),
+            meshLodLevels(0), extractRootMotion(false), boundsMin(0.0f), boundsMax(0.0f)
         {
             scene = nullptr;
+            importReport = nullptr;
         }
 
         ~Model()
@@ -45,79 +88,166 @@ class Model
             scene = nullptr;
         }
 
+        // copies everything the model needs out of the scene, which is only borrowed for the duration of the call
         void InitFromScene(const aiScene* scene)
         {
+            PROFILE_SCOPE("InitFromScene");
             this->scene = scene;
-            globalInverseTransform = mat4Convert(scene->mRootNode->mTransformation);
-            globalInverseTransform = glm::inverse(globalInverseTransform);
-
-            if (scene->HasAnimations() && scene->mAnimations[currentAnimation]->mTicksPerSecond != 0.0f)
-                ticksPerSecond = scene->mAnimations[currentAnimation]->mTicksPerSecond;
-            else
-                ticksPerSecond = 25.0f;
+            skeleton.GlobalInverseTransform = mat4Convert(scene->mRootNode->mTransformation);
+            skeleton.GlobalInverseTransform = glm::inverse(skeleton.GlobalInverseTransform);
 
             // process ASSIMP's root node recursively
-            processNode(scene->mRootNode);
+            {
+                ImportStageTimer timer(importReport, "processNode");
+                processNode(scene->mRootNode);
+            }
+
+            // the bones are known once all the meshes are processed, now flatten the node hierarchy and the animations
+            {
+                ImportStageTimer timer(importReport, "skeleton");
+                processSkeleton(scene->mRootNode, -1);
+                Animation::BuildSkeletonLods(skeleton);
+            }
+            {
+                ImportStageTimer timer(importReport, "animations");
+                for (unsigned int i = 0; i < scene->mNumAnimations; i++)
+                    clips.push_back(processAnimation(scene->mAnimations[i]));
+            }
+            rootMotion.resize(clips.size());
+            if (extractRootMotion)
+            {
+                ImportStageTimer timer(importReport, "root motion");
+                for (unsigned int i = 0; i < clips.size(); i++)
+                    rootMotion[i] = RootMotion::Extract(skeleton, clips[i]);
+            }
+            pose.Resize(skeleton);
+
+            if (importReport)
+                countImport(*importReport);
+            this->scene = nullptr;
         }
 
-        // draws the model, and thus all its meshes
-        void Draw(Shader shader)
+        // draws the model, and thus all its meshes, at a level of detail (see SelectMeshLod)
+        void Draw(const Shader& shader, unsigned int lod = 0) const
         {
+            PROFILE_SCOPE("Model::Draw");
             for(unsigned int i = 0; i < meshes.size(); i++)
-                meshes[i].Draw(shader);
+                meshes[i].Draw(shader, lod);
         }
 
         void SetAnimation(unsigned int animation)
         {
-            if (animation >= 0 && animation < GetNumAnimations())
+            if (animation < GetNumAnimations())
                 currentAnimation = animation;
         }
 
-        void SetBoneTransformations(Shader shader, GLfloat currentTime)
+        // evaluates the current animation into the model's pose buffers, which are reused every frame,
+        // and writes the palette into the frame's ring buffer, bound to the bones block
+        void SetBoneTransformations(FrameRingBuffer& palettes, GLfloat currentTime)
         {
             if (HasAnimations())
             {
-                std::vector<glm::mat4> transforms;
-                boneTransform((float)currentTime, transforms);
-                shader.SetMatrix4v("gBones", transforms);
+                boneTransform((float)currentTime);
+                size_t bytes = std::min(pose.Palette.size(), (size_t)MAX_BONES) * sizeof(glm::mat4);
+                RingAllocation allocation = palettes.Allocate(bytes);
+                if (allocation.Data == nullptr)
+                    return;
+                std::memcpy(allocation.Data, &pose.Palette[0], bytes);
+                glBindBufferRange(GL_UNIFORM_BUFFER, BONES_BLOCK_BINDING, palettes.GetBuffer(), allocation.Offset, BONES_BLOCK_BYTES);
             }
         }
 
         void SetDirectory(const std::string directory) { this->directory = directory; }
-        bool HasAnimations() { return scene->HasAnimations(); }
-        unsigned int GetNumAnimations() { return scene->mNumAnimations; }
-
-    private:
-        #define NUM_BONES_PER_VERTEX 4
-
-        struct BoneMatrix
+        // vertices closer than this in every attribute are merged at import, a negative value disables welding
+        void SetWeldTolerance(float tolerance) { weldTolerance = tolerance; }
+        // simplified levels generated per mesh at import (at most MESH_LOD_LEVELS - 1), 0 disables them
+        void SetMeshLodLevels(unsigned int levels) { meshLodLevels = std::min(levels, MESH_LOD_LEVELS - 1); }
+        // moves the ground motion and turn of the root out of the clips into root motion tracks, must be set before InitFromScene
+        void SetExtractRootMotion(bool extract) { extractRootMotion = extract; }
+        const std::vector<WeldStats>& GetWeldStats() const { return weldStats; }
+        // what the meshes keep in system memory after upload, must be set before InitFromScene
+        void SetResidencyPolicy(ResidencyPolicy policy) { residency = policy; }
+        // when disabled no GL object is created, so the model can be imported without a context
+        void SetUploadToGPU(bool upload) { uploadToGPU = upload; }
+        // times the stages of InitFromScene into report, which must outlive the call. nullptr disables it.
+        void SetImportReport(ImportReport* report) { importReport = report; }
+        bool HasAnimations() const { return !clips.empty(); }
+        unsigned int GetNumAnimations() const { return (unsigned int)clips.size(); }
+        const Skeleton& GetSkeleton() const { return skeleton; }
+        const AnimationClip& GetAnimation(unsigned int animation) const { return clips[animation]; }
+        // empty unless the root motion was extracted and the clip moves its root
+        const RootMotionTrack& GetRootMotion(unsigned int animation) const { return rootMotion[animation]; }
+        const std::vector<Mesh>& GetMeshes() const { return meshes; }
+        // box around the bind pose of all the meshes, in model space
+        const glm::vec3& GetBoundsMin() const { return boundsMin; }
+        const glm::vec3& GetBoundsMax() const { return boundsMax; }
+
+        ModelMemoryReport GetMemoryReport() const
         {
-            glm::mat4 BoneOffset;
-            glm::mat4 FinalTransformation;
+            ModelMemoryReport report;
+            for (unsigned int i = 0; i < meshes.size(); i++)
+                report.Meshes.push_back(ModelMemoryReport::Entry(meshes[i].Name, meshes[i].GetMemoryUsage()));
 
-            BoneMatrix()
+            std::vector<unsigned int> counted;
+            for (unsigned int i = 0; i < textureRefs.size(); i++)
             {
-                BoneOffset = glm::mat4(0.0f);
-                FinalTransformation = glm::mat4(0.0f);
+                TextureHandle handle = textureRefs[i].Handle();
+                if (std::find(counted.begin(), counted.end(), handle.Index) != counted.end())
+                    continue;
+                counted.push_back(handle.Index);
+                TextureManager& textures = TextureManager::Get();
+                report.Textures.push_back(ModelMemoryReport::Entry(textures.GetPath(handle), MemoryUsage(textures.GetCPUBytes(handle), textures.GetGPUBytes(handle))));
             }
-        };
 
+            for (unsigned int i = 0; i < clips.size(); i++)
+                report.Clips.push_back(ModelMemoryReport::Entry(clips[i].Name, MemoryUsage(clips[i].GetCPUBytes() + rootMotion[i].GetCPUBytes(), 0)));
+
+            report.Skeleton.CPUBytes = skeleton.GetCPUBytes()
+                + pose.Local.capacity() * sizeof(glm::mat4) + pose.Global.capacity() * sizeof(glm::mat4) + pose.Palette.capacity() * sizeof(glm::mat4);
+            for (std::map<std::string, unsigned int>::const_iterator it = boneMapping.begin(); it != boneMapping.end(); ++it)
+                report.Skeleton.CPUBytes += sizeof(*it) + it->first.capacity();
+
+            report.Total = report.Skeleton;
+            for (unsigned int i = 0; i < report.Meshes.size(); i++)
+                report.Total += report.Meshes[i].Usage;
+            for (unsigned int i = 0; i < report.Textures.size(); i++)
+                report.Total += report.Textures[i].Usage;
+            for (unsigned int i = 0; i < report.Clips.size(); i++)
+                report.Total += report.Clips[i].Usage;
+            return report;
+        }
+
+    private:
+        #define NUM_BONES_PER_VERTEX 4
+
+        // only valid while InitFromScene runs
         const aiScene* scene;
+        ImportReport* importReport;
 
         std::string directory;
         std::vector<Mesh> meshes;
-        // stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
-        std::vector<Texture> loadedTextures;
+        // references to the shared textures used by the meshes, released when the model goes away.
+        std::vector<TextureRef> textureRefs;
 
-        glm::mat4 globalInverseTransform;
-        GLfloat ticksPerSecond = 0.0f;
-        // duration of the animation, can be changed if frames are not present in all interval
-        double animDuration;
+        Skeleton skeleton;
+        std::vector<AnimationClip> clips;
+        // same index as clips
+        std::vector<RootMotionTrack> rootMotion;
         unsigned int currentAnimation;
+        Pose pose;
 
         unsigned int bonesCount = 0;
         std::map<std::string, unsigned int> boneMapping;
-        std::vector<BoneMatrix> boneMatrices;
+
+        float weldTolerance;
+        // vertex count before/after welding, one entry per mesh
+        std::vector<WeldStats> weldStats;
+        ResidencyPolicy residency;
+        bool uploadToGPU;
+        unsigned int meshLodLevels;
+        bool extractRootMotion;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
 
         // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
         void processNode(aiNode *node)
@@ -129,6 +259,7 @@ class Model
                 // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
                 aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
                 meshes.push_back(processMesh(mesh));
+                meshes.back().ApplyResidency(residency);
             }
             // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
             for (unsigned int i = 0; i < node->mNumChildren; i++)
@@ -137,94 +268,131 @@ class Model
 
         Mesh processMesh(aiMesh *mesh)
         {
+            ImportStageTimer meshTimer(importReport, "processMesh");
             // data to fill
             std::vector<Vertex> vertices;
             std::vector<unsigned int> indices;
             std::vector<Texture> textures;
 
             // Walk through each of the mesh's vertices
-            for (unsigned int i = 0; i < mesh->mNumVertices; i++)
             {
-                Vertex vertex;
-                // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert
-                // to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-                glm::vec3 vector;
-                // positions
-                vector.x = mesh->mVertices[i].x;
-                vector.y = mesh->mVertices[i].y;
-                vector.z = mesh->mVertices[i].z;
-                vertex.Position = vector;
-                // normals
-                if (mesh->HasNormals())
-                {
-                    vector.x = mesh->mNormals[i].x;
-                    vector.y = mesh->mNormals[i].y;
-                    vector.z = mesh->mNormals[i].z;
-                    vertex.Normal = vector;
-                }
-                // texture coordinates
-                if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+                ImportStageTimer timer(importReport, "vertices");
+                for (unsigned int i = 0; i < mesh->mNumVertices; i++)
                 {
-                    glm::vec2 vec;
-                    // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
-                    // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                    vec.x = mesh->mTextureCoords[0][i].x;
-                    vec.y = mesh->mTextureCoords[0][i].y;
-                    vertex.TexCoords = vec;
+                    Vertex vertex;
+                    // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert
+                    // to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
+                    glm::vec3 vector;
+                    // positions
+                    vector.x = mesh->mVertices[i].x;
+                    vector.y = mesh->mVertices[i].y;
+                    vector.z = mesh->mVertices[i].z;
+                    vertex.Position = vector;
+                    // normals
+                    if (mesh->HasNormals())
+                    {
+                        vector.x = mesh->mNormals[i].x;
+                        vector.y = mesh->mNormals[i].y;
+                        vector.z = mesh->mNormals[i].z;
+                        vertex.Normal = vector;
+                    }
+                    // texture coordinates
+                    if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+                    {
+                        glm::vec2 vec;
+                        // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
+                        // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
+                        vec.x = mesh->mTextureCoords[0][i].x;
+                        vec.y = mesh->mTextureCoords[0][i].y;
+                        vertex.TexCoords = vec;
+                    }
+                    else
+                        vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+                    if (!mesh->HasNormals())
+                        vertex.Normal = glm::vec3(0.0f);
+
+                    // Bone Weights are initialised in next for loop
+                    vertex.BoneIDs = glm::ivec4(0);
+                    vertex.BoneWeights = glm::vec4(0.0f);
+
+                    vertices.push_back(vertex);
+                    if (meshes.empty() && i == 0)
+                        boundsMin = boundsMax = vertex.Position;
+                    boundsMin = glm::min(boundsMin, vertex.Position);
+                    boundsMax = glm::max(boundsMax, vertex.Position);
                 }
-                else
-                    vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-                // Bone Weights are initialised in next for loop
-                vertex.BoneWeights = glm::vec4(0.0f);
-
-                vertices.push_back(vertex);
             }
 
             // process bones
-            for (unsigned int i = 0; i < mesh->mNumBones; i++)
             {
-                unsigned int boneIndex = 0;
-                std::string boneName(mesh->mBones[i]->mName.data);
-
-                if (boneMapping.find(boneName) == boneMapping.end())
+                ImportStageTimer timer(importReport, "bone weights");
+                for (unsigned int i = 0; i < mesh->mNumBones; i++)
                 {
-                    // allocate an index for the new bone
-                    boneIndex = bonesCount;
-                    bonesCount++;
-                    BoneMatrix boneMatrix;
-                    boneMatrices.push_back(boneMatrix);
-
-                    boneMatrices[boneIndex].BoneOffset = mat4Convert(mesh->mBones[i]->mOffsetMatrix);
-                    boneMapping[boneName] = boneIndex;
-                }
-                else
-                    boneIndex = boneMapping[boneName];
+                    unsigned int boneIndex = 0;
+                    std::string boneName(mesh->mBones[i]->mName.data);
 
-                for (unsigned int j = 0; j < mesh->mBones[i]->mNumWeights; j++)
-                {
-                    unsigned int vertexID = mesh->mBones[i]->mWeights[j].mVertexId;
-                    float weight = mesh->mBones[i]->mWeights[j].mWeight;
+                    if (boneMapping.find(boneName) == boneMapping.end())
+                    {
+                        // allocate an index for the new bone
+                        boneIndex = bonesCount;
+                        bonesCount++;
+                        skeleton.BoneOffsets.push_back(mat4Convert(mesh->mBones[i]->mOffsetMatrix));
+                        skeleton.BoneBoundsMin.push_back(glm::vec3(1e30f));
+                        skeleton.BoneBoundsMax.push_back(glm::vec3(-1e30f));
+                        boneMapping[boneName] = boneIndex;
+                    }
+                    else
+                        boneIndex = boneMapping[boneName];
 
-                    for (unsigned int g = 0; g < NUM_BONES_PER_VERTEX; g++)
+                    for (unsigned int j = 0; j < mesh->mBones[i]->mNumWeights; j++)
                     {
-                        if (vertices[vertexID].BoneWeights[g] == 0.0)
+                        unsigned int vertexID = mesh->mBones[i]->mWeights[j].mVertexId;
+                        float weight = mesh->mBones[i]->mWeights[j].mWeight;
+                        if (weight > 0.0f)
+                        {
+                            skeleton.BoneBoundsMin[boneIndex] = glm::min(skeleton.BoneBoundsMin[boneIndex], vertices[vertexID].Position);
+                            skeleton.BoneBoundsMax[boneIndex] = glm::max(skeleton.BoneBoundsMax[boneIndex], vertices[vertexID].Position);
+                        }
+
+                        for (unsigned int g = 0; g < NUM_BONES_PER_VERTEX; g++)
                         {
-                            vertices[vertexID].BoneIDs[g] = boneIndex;
-                            vertices[vertexID].BoneWeights[g] = weight;
-                            break;
+                            if (vertices[vertexID].BoneWeights[g] == 0.0)
+                            {
+                                vertices[vertexID].BoneIDs[g] = boneIndex;
+                                vertices[vertexID].BoneWeights[g] = weight;
+                                break;
+                            }
                         }
                     }
                 }
             }
 
             // now walk through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
-            for(unsigned int i = 0; i < mesh->mNumFaces; i++)
             {
-                aiFace face = mesh->mFaces[i];
-                // retrieve all indices of the face and store them in the indices vector
-                for(unsigned int j = 0; j < face.mNumIndices; j++)
-                    indices.push_back(face.mIndices[j]);
+                ImportStageTimer timer(importReport, "faces");
+                for(unsigned int i = 0; i < mesh->mNumFaces; i++)
+                {
+                    aiFace face = mesh->mFaces[i];
+                    // retrieve all indices of the face and store them in the indices vector
+                    for(unsigned int j = 0; j < face.mNumIndices; j++)
+                        indices.push_back(face.mIndices[j]);
+                }
+            }
+
+            // merge the duplicates left over by triangulation and normal splitting
+            if (weldTolerance >= 0.0f)
+            {
+                ImportStageTimer timer(importReport, "weld");
+                WeldStats stats = MeshOptimizer::WeldVertices(vertices, indices, weldTolerance);
+                weldStats.push_back(stats);
+            }
+
+            // simplified index buffers for distant instances, appended to indices and sharing the vertices
+            std::vector<MeshLod> lods;
+            if (meshLodLevels > 0 && !indices.empty())
+            {
+                ImportStageTimer timer(importReport, "simplify");
+                lods = MeshOptimizer::GenerateLods(vertices, indices, meshLodLevels);
             }
 
             // process materials
@@ -251,185 +419,150 @@ class Model
             textures.insert(textures.end(), emissionMaps.begin(), emissionMaps.end());
 
             // return a mesh object created from the extracted mesh data
-            return Mesh(vertices, indices, textures);
+            ImportStageTimer uploadTimer(uploadToGPU ? importReport : nullptr, "mesh upload");
+            return Mesh(std::move(vertices), std::move(indices), std::move(textures), mesh->mName.C_Str(), uploadToGPU, std::move(lods));
         }
 
-        void boneTransform(float timeInSeconds, std::vector<glm::mat4>& transforms)
+        // flattens the node hierarchy depth first, so parents are always evaluated before their children
+        void processSkeleton(const aiNode* node, int parent)
         {
-            glm::mat4 identity = glm::mat4(1.0f);
-
-            // Calculate animation duration
-            unsigned int numPosKeys = scene->mAnimations[currentAnimation]->mChannels[0]->mNumPositionKeys;
-            animDuration = scene->mAnimations[currentAnimation]->mChannels[0]->mPositionKeys[numPosKeys - 1].mTime;
-
-            float ticksPerSecond = (float)(scene->mAnimations[currentAnimation]->mTicksPerSecond != 0 ? scene->mAnimations[currentAnimation]->mTicksPerSecond : 25.0f);
-            float timeInTicks = timeInSeconds * ticksPerSecond;
-            float animationTime = fmod(timeInTicks, animDuration);
-            readNodeHeirarchy(animationTime, scene->mRootNode, identity);
-            transforms.resize(bonesCount);
-
-            for (unsigned int  i = 0; i < bonesCount; i++)
-                transforms[i] = boneMatrices[i].FinalTransformation;
-        }
-
-        unsigned int findPosition(float animationTime, const aiNodeAnim* nodeAnim)
-        {
-            for (unsigned int i = 0 ; i < nodeAnim->mNumPositionKeys - 1 ; i++)
-                if (animationTime < (float)nodeAnim->mPositionKeys[i + 1].mTime)
-                    return i;
-
-            assert(0);
-            return 0;
+            Joint joint;
+            joint.Name = node->mName.data;
+            joint.Parent = parent;
+            std::map<std::string, unsigned int>::const_iterator bone = boneMapping.find(joint.Name);
+            joint.Bone = bone != boneMapping.end() ? (int)bone->second : -1;
+            joint.LocalTransform = mat4Convert(node->mTransformation);
+
+            int index = (int)skeleton.Joints.size();
+            skeleton.Joints.push_back(joint);
+            for (unsigned int i = 0 ; i < node->mNumChildren ; i++)
+                processSkeleton(node->mChildren[i], index);
         }
 
-        unsigned int findRotation(float animationTime, const aiNodeAnim* nodeAnim)
+        AnimationClip processAnimation(const aiAnimation* animation)
         {
-            assert(nodeAnim->mNumRotationKeys > 0);
-
-            for (unsigned int i = 0 ; i < nodeAnim->mNumRotationKeys - 1 ; i++)
-                if (animationTime < (float)nodeAnim->mRotationKeys[i + 1].mTime)
-                    return i;
-
-            assert(0);
-            return 0;
-        }
+            AnimationClip clip;
+            clip.Name = animation->mName.C_Str();
+            clip.TicksPerSecond = (float)(animation->mTicksPerSecond != 0 ? animation->mTicksPerSecond : 25.0f);
+            clip.Duration = (float)animation->mDuration;
 
-        unsigned int findScaling(float animationTime, const aiNodeAnim* nodeAnim)
-        {
-            assert(nodeAnim->mNumScalingKeys > 0);
+            for (unsigned int i = 0 ; i < animation->mNumChannels ; i++)
+            {
+                const aiNodeAnim* nodeAnim = animation->mChannels[i];
+                int joint = findJoint(nodeAnim->mNodeName.data);
+                if (joint < 0)
+                    continue;
 
-            for (unsigned int i = 0 ; i < nodeAnim->mNumScalingKeys - 1 ; i++)
-                if (animationTime < (float)nodeAnim->mScalingKeys[i + 1].mTime)
-                    return i;
+                AnimationChannel channel;
+                channel.Joint = (unsigned int)joint;
+                for (unsigned int k = 0; k < nodeAnim->mNumPositionKeys; k++)
+                {
+                    VectorKey key = { (float)nodeAnim->mPositionKeys[k].mTime, vec3Convert(nodeAnim->mPositionKeys[k].mValue) };
+                    channel.PositionKeys.push_back(key);
+                }
+                for (unsigned int k = 0; k < nodeAnim->mNumRotationKeys; k++)
+                {
+                    QuatKey key = { (float)nodeAnim->mRotationKeys[k].mTime, quatConvert(nodeAnim->mRotationKeys[k].mValue) };
+                    channel.RotationKeys.push_back(key);
+                }
+                for (unsigned int k = 0; k < nodeAnim->mNumScalingKeys; k++)
+                {
+                    VectorKey key = { (float)nodeAnim->mScalingKeys[k].mTime, vec3Convert(nodeAnim->mScalingKeys[k].mValue) };
+                    channel.ScalingKeys.push_back(key);
+                }
+                // a track without keys keeps the bind pose of the joint
+                if (channel.PositionKeys.empty() || channel.RotationKeys.empty() || channel.ScalingKeys.empty())
+                {
+                    aiVector3D scaling, position;
+                    aiQuaternion rotation;
+                    skeletonNode(joint)->mTransformation.Decompose(scaling, rotation, position);
+                    VectorKey positionKey = { 0.0f, vec3Convert(position) };
+                    QuatKey rotationKey = { 0.0f, quatConvert(rotation) };
+                    VectorKey scalingKey = { 0.0f, vec3Convert(scaling) };
+                    if (channel.PositionKeys.empty())
+                        channel.PositionKeys.push_back(positionKey);
+                    if (channel.RotationKeys.empty())
+                        channel.RotationKeys.push_back(rotationKey);
+                    if (channel.ScalingKeys.empty())
+                        channel.ScalingKeys.push_back(scalingKey);
+                }
+                clip.Channels.push_back(channel);
+            }
 
-            assert(0);
-            return 0;
+            // the loop length is taken from the last position key of the first channel
+            if (!clip.Channels.empty())
+                clip.Duration = clip.Channels[0].PositionKeys.back().Time;
+            return clip;
         }
 
-        void calcInterpolatedPosition(aiVector3D& out, float animationTime, const aiNodeAnim* nodeAnim)
+        int findJoint(const std::string& name) const
         {
-            if (nodeAnim->mNumPositionKeys == 1)
-            {
-                out = nodeAnim->mPositionKeys[0].mValue;
-                return;
-            }
-
-            unsigned int positionIndex = findPosition(animationTime, nodeAnim);
-            unsigned int nextPositionIndex = (positionIndex + 1);
-            assert(nextPositionIndex < nodeAnim->mNumPositionKeys);
-            float deltaTime = (float)(nodeAnim->mPositionKeys[nextPositionIndex].mTime - nodeAnim->mPositionKeys[positionIndex].mTime);
-            float factor = (animationTime - (float)nodeAnim->mPositionKeys[positionIndex].mTime) / deltaTime;
-            assert(factor >= 0.0f && factor <= 1.0f);
-            const aiVector3D& start = nodeAnim->mPositionKeys[positionIndex].mValue;
-            const aiVector3D& end = nodeAnim->mPositionKeys[nextPositionIndex].mValue;
-            aiVector3D delta = end - start;
-            out = start + factor * delta;
+            for (unsigned int i = 0; i < skeleton.Joints.size(); i++)
+                if (skeleton.Joints[i].Name == name)
+                    return (int)i;
+            return -1;
         }
 
-        void calcInterpolatedRotation(aiQuaternion& out, float animationTime, const aiNodeAnim* nodeAnim)
+        const aiNode* skeletonNode(int joint) const
         {
-            // we need at least two values to interpolate...
-            if (nodeAnim->mNumRotationKeys == 1)
-            {
-                out = nodeAnim->mRotationKeys[0].mValue;
-                return;
-            }
-
-            unsigned int rotationIndex = findRotation(animationTime, nodeAnim);
-            unsigned int nextRotationIndex = (rotationIndex + 1);
-            assert(nextRotationIndex < nodeAnim->mNumRotationKeys);
-            float deltaTime = (float)(nodeAnim->mRotationKeys[nextRotationIndex].mTime - nodeAnim->mRotationKeys[rotationIndex].mTime);
-            float factor = (animationTime - (float)nodeAnim->mRotationKeys[rotationIndex].mTime) / deltaTime;
-            assert(factor >= 0.0f && factor <= 1.0f);
-            const aiQuaternion& startRotationQ = nodeAnim->mRotationKeys[rotationIndex].mValue;
-            const aiQuaternion& endRotationQ   = nodeAnim->mRotationKeys[nextRotationIndex].mValue;
-            aiQuaternion::Interpolate(out, startRotationQ, endRotationQ, factor);
-            out = out.Normalize();
+            return scene->mRootNode->FindNode(skeleton.Joints[joint].Name.c_str());
         }
 
-        void calcInterpolatedScaling(aiVector3D& out, float animationTime, const aiNodeAnim* nodeAnim)
+        // sizes of what went through the import, the scene is still valid
+        void countImport(ImportReport& report) const
         {
-            if (nodeAnim->mNumScalingKeys == 1)
+            uint64_t weights = 0, bones = 0;
+            for (unsigned int i = 0; i < scene->mNumMeshes; i++)
             {
-                out = nodeAnim->mScalingKeys[0].mValue;
-                return;
+                bones += scene->mMeshes[i]->mNumBones;
+                for (unsigned int b = 0; b < scene->mMeshes[i]->mNumBones; b++)
+                    weights += scene->mMeshes[i]->mBones[b]->mNumWeights;
             }
-
-            unsigned int scalingIndex = findScaling(animationTime, nodeAnim);
-            unsigned int nextScalingIndex = (scalingIndex + 1);
-            assert(nextScalingIndex < nodeAnim->mNumScalingKeys);
-            float deltaTime = (float)(nodeAnim->mScalingKeys[nextScalingIndex].mTime - nodeAnim->mScalingKeys[scalingIndex].mTime);
-            float factor = (animationTime - (float)nodeAnim->mScalingKeys[scalingIndex].mTime) / deltaTime;
-            assert(factor >= 0.0f && factor <= 1.0f);
-            const aiVector3D& start = nodeAnim->mScalingKeys[scalingIndex].mValue;
-            const aiVector3D& end   = nodeAnim->mScalingKeys[nextScalingIndex].mValue;
-            aiVector3D delta = end - start;
-            out = start + factor * delta;
-        }
-
-        void readNodeHeirarchy(float animationTime, const aiNode* node, const glm::mat4& parentTransform)
-        {
-            std::string nodeName(node->mName.data);
-
-            const aiAnimation* animation = scene->mAnimations[currentAnimation];
-
-            glm::mat4 nodeTransformation = mat4Convert(node->mTransformation);
-
-            const aiNodeAnim* nodeAnim = findNodeAnim(animation, nodeName);
-
-            if (nodeAnim)
+            uint64_t vertices = 0, indices = 0, keys = 0, channels = 0;
+            for (unsigned int i = 0; i < meshes.size(); i++)
             {
-                // Interpolate scaling and generate scaling transformation matrix
-                aiVector3D scaling;
-                calcInterpolatedScaling(scaling, animationTime, nodeAnim);
-                glm::vec3 scale = glm::vec3(scaling.x, scaling.y, scaling.z);
-                glm::mat4 scalingM = glm::scale(glm::mat4(1.0f), scale);
-
-                // Interpolate rotation and generate rotation transformation matrix
-                aiQuaternion rotationQ;
-                calcInterpolatedRotation(rotationQ, animationTime, nodeAnim);
-                glm::quat rotate = quatConvert(rotationQ);
-                glm::mat4 rotationM = glm::toMat4(rotate);
-
-                // Interpolate translation and generate translation transformation matrix
-                aiVector3D translation;
-                calcInterpolatedPosition(translation, animationTime, nodeAnim);
-                glm::vec3 translate = glm::vec3(translation.x, translation.y, translation.z);
-                glm::mat4 translationM = glm::translate(glm::mat4(1.0f), translate);
-
-                // Combine the above transformations
-                nodeTransformation = translationM * rotationM * scalingM;
+                vertices += meshes[i].GetVertexCount();
+                indices += meshes[i].GetIndexCount();
             }
-
-            // Combine with node Transformation with Parent Transformation
-            glm::mat4 globalTransformation = parentTransform * nodeTransformation;
-
-            if (boneMapping.find(nodeName) != boneMapping.end())
+            for (unsigned int i = 0; i < clips.size(); i++)
             {
-                unsigned int boneIndex = boneMapping[nodeName];
-                boneMatrices[boneIndex].FinalTransformation = globalInverseTransform * globalTransformation * boneMatrices[boneIndex].BoneOffset;
+                channels += clips[i].Channels.size();
+                for (unsigned int c = 0; c < clips[i].Channels.size(); c++)
+                {
+                    const AnimationChannel& channel = clips[i].Channels[c];
+                    keys += channel.PositionKeys.size() + channel.RotationKeys.size() + channel.ScalingKeys.size();
+                }
             }
-
-            for (unsigned int i = 0 ; i < node->mNumChildren ; i++)
-                readNodeHeirarchy(animationTime, node->mChildren[i], globalTransformation);
+            report.AddCount("meshes", meshes.size());
+            report.AddCount("vertices", vertices);
+            uint64_t merged = 0;
+            for (unsigned int i = 0; i < weldStats.size(); i++)
+                merged += weldStats[i].VerticesIn - weldStats[i].VerticesOut;
+            if (!weldStats.empty())
+                report.AddCount("vertices merged by weld", merged);
+            report.AddCount("triangles", indices / 3);
+            for (unsigned int i = 0; i < meshes.size(); i++)
+                for (unsigned int l = 1; l < meshes[i].GetLods().size(); l++)
+                    report.AddCount(("triangles at mesh lod " + std::to_string(l)).c_str(), meshes[i].GetLods()[l].Count / 3);
+            report.AddCount("mesh bones", bones);
+            report.AddCount("bone weights", weights);
+            report.AddCount("palette bones", skeleton.GetNumBones());
+            report.AddCount("joints", skeleton.Joints.size());
+            for (unsigned int i = 1; i < skeleton.Lods.size(); i++)
+                report.AddCount(("joints at skeleton lod " + std::to_string(i)).c_str(), skeleton.Lods[i].Joints.size());
+            report.AddCount("clips", clips.size());
+            report.AddCount("channels", channels);
+            report.AddCount("keys", keys);
         }
 
-        const aiNodeAnim* findNodeAnim(const aiAnimation* animation, const std::string nodeName)
+        void boneTransform(float timeInSeconds)
         {
-            for (unsigned int i = 0 ; i < animation->mNumChannels ; i++)
-            {
-                const aiNodeAnim* nodeAnim = animation->mChannels[i];
-
-                if (std::string(nodeAnim->mNodeName.data) == nodeName)
-                    return nodeAnim;
-            }
-
-            return nullptr;
+            PROFILE_SCOPE("boneTransform");
+            Animation::EvaluatePose(skeleton, clips[currentAnimation], timeInSeconds, pose);
         }
 
-        // checks all material textures of a given type and loads the textures if they're not loaded yet.
-        // the required info is returned as a Texture struct.
-        // checks all material textures of a given type and loads the textures if they're not loaded yet.
+        // checks all material textures of a given type and acquires them from the shared texture registry,
+        // which only loads an image the first time any model asks for it.
         // the required info is returned as a Texture struct.
         std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
         {
@@ -438,70 +571,19 @@ class Model
             {
                 aiString str;
                 mat->GetTexture(type, i, &str);
-                // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-                bool skip = false;
-                for (unsigned int j = 0; j < loadedTextures.size(); j++)
+                Texture texture;
+                texture.ID = 0;
+                texture.Type = typeName;
+                texture.Path = str.C_Str();
+                if (uploadToGPU)
                 {
-                    if (strcmp(loadedTextures[j].Path.data(), str.C_Str()) == 0)
-                    {
-                        textures.push_back(loadedTextures[j]);
-                        skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                        break;
-                    }
-                }
-                if (!skip)
-                {   // if texture hasn't been loaded already, load it
-                    Texture texture;
-                    texture.ID = TextureFromFile(str.C_Str(), this->directory);
-                    texture.Type = typeName;
-                    texture.Path = str.C_Str();
-                    textures.push_back(texture);
-                    loadedTextures.push_back(texture); // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+                    TextureRef ref(TextureManager::Get().Acquire(directory + '/' + str.C_Str(), GL_REPEAT, GL_NEAREST_MIPMAP_NEAREST, GL_NEAREST, importReport));
+                    texture.ID = ref.ID();
+                    textureRefs.push_back(ref);
                 }
+                textures.push_back(texture);
             }
             return textures;
         }
 };
-
-unsigned int TextureFromFile(const char* filename, const std::string& directory, bool /* gamma */)
-{
-    std::string path(filename);
-    path = directory + '/' + path;
-
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-        else
-            format = GL_RED;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
-}
 #endif
\ No newline at end of file
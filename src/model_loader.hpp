@@ -0,0 +1,142 @@
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include "import_report.hpp"
+#include "model.hpp"
+#include "profiler.hpp"
+
+// post-processing applied to every imported model
+const unsigned int IMPORT_POST_PROCESS_FLAGS = aiProcessPreset_TargetRealtime_Fast | aiProcess_GlobalScale | aiProcess_LimitBoneWeights;
+
+struct ModelLoadOptions
+{
+    ResidencyPolicy Residency;
+    // false imports only the CPU side (meshes, skeleton, clips) and doesn't need a GL context
+    bool UploadToGPU;
+    // negative disables vertex welding
+    float WeldTolerance;
+    // simplified levels generated per mesh, 0 disables mesh LOD
+    unsigned int MeshLodLevels;
+    // takes the root motion out of the clips into tracks (see root_motion.hpp)
+    bool ExtractRootMotion;
+    // when set, every stage of the import is timed into it
+    ImportReport* Report;
+
+    ModelLoadOptions() : Residency(ResidencyPolicy::KeepCPUData), UploadToGPU(true), WeldTolerance(1e-5f), MeshLodLevels(0), ExtractRootMotion(false),
+        Report(nullptr) {}
+};
+
+// ReadFile with its stages split apart for the report: the file is read into memory, parsed without
+// post-processing, then every post-process step is applied on its own in the order ASSIMP runs them.
+inline const aiScene* ReadFileInStages(Assimp::Importer& importer, const std::string& path, unsigned int flags, ImportReport& report)
+{
+    struct PostProcessStep
+    {
+        unsigned int Flag;
+        const char* Name;
+    };
+    static const PostProcessStep steps[] = {
+        { aiProcess_GenUVCoords, "GenUVCoords" },
+        { aiProcess_GlobalScale, "GlobalScale" },
+        { aiProcess_Triangulate, "Triangulate" },
+        { aiProcess_SortByPType, "SortByPType" },
+        { aiProcess_GenNormals, "GenNormals" },
+        { aiProcess_GenSmoothNormals, "GenSmoothNormals" },
+        { aiProcess_CalcTangentSpace, "CalcTangentSpace" },
+        { aiProcess_JoinIdenticalVertices, "JoinIdenticalVertices" },
+        { aiProcess_LimitBoneWeights, "LimitBoneWeights" },
+        { aiProcess_ImproveCacheLocality, "ImproveCacheLocality" },
+    };
+
+    std::vector<char> buffer;
+    {
+        ImportStageTimer timer(&report, "file read");
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (!file)
+            return nullptr;
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        report.AddCount("file bytes", buffer.size());
+    }
+
+    const aiScene* scene;
+    {
+        ImportStageTimer timer(&report, "parse");
+        std::string extension = path.substr(path.find_last_of('.') + 1);
+        scene = importer.ReadFileFromMemory(buffer.data(), buffer.size(), 0, extension.c_str());
+    }
+
+    ImportStageTimer postProcessTimer(&report, "post-process");
+    unsigned int remaining = flags;
+    for (unsigned int i = 0; scene && i < sizeof(steps) / sizeof(steps[0]); i++)
+    {
+        if (!(remaining & steps[i].Flag))
+            continue;
+        remaining &= ~steps[i].Flag;
+        ImportStageTimer timer(&report, steps[i].Name);
+        scene = importer.ApplyPostProcessing(steps[i].Flag);
+    }
+    // steps without their own entry run together
+    if (scene && remaining)
+    {
+        ImportStageTimer timer(&report, "other steps");
+        scene = importer.ApplyPostProcessing(remaining);
+    }
+    return scene;
+}
+
+inline Model LoadModelFromFilename(const std::string& path, const ModelLoadOptions& options = ModelLoadOptions())
+{
+    PROFILE_SCOPE("Import");
+    Timer total;
+    Model model;
+    model.SetResidencyPolicy(options.Residency);
+    model.SetUploadToGPU(options.UploadToGPU);
+    model.SetWeldTolerance(options.WeldTolerance);
+    model.SetMeshLodLevels(options.MeshLodLevels);
+    model.SetExtractRootMotion(options.ExtractRootMotion);
+    // read file via ASSIMP
+    Assimp::Importer importer;
+    const aiScene* scene;
+    {
+        PROFILE_SCOPE("Assimp::ReadFile");
+        if (options.Report)
+            scene = ReadFileInStages(importer, path, IMPORT_POST_PROCESS_FLAGS, *options.Report);
+        else
+            scene = importer.ReadFile(path, IMPORT_POST_PROCESS_FLAGS);
+    }
+    // check for errors
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        std::cout << "ERROR::ASSIMP: " << importer.GetErrorString() << std::endl;
+    }
+    else {
+        // retrieve the directory path of the filepath
+        model.SetDirectory(path.substr(0, path.find_last_of('/')));
+        // the model copies what it needs, the importer frees the scene when it goes out of scope
+        model.SetImportReport(options.Report);
+        {
+            ImportStageTimer timer(options.Report, "InitFromScene");
+            model.InitFromScene(scene);
+        }
+        model.SetImportReport(nullptr);
+    }
+    if (options.Report)
+    {
+        options.Report->Asset = path;
+        options.Report->Imported = !model.GetMeshes().empty();
+        options.Report->TotalMilliseconds = total.ElapsedMilliseconds();
+    }
+    return model;
+}
+
+#endif
@@ -0,0 +1,286 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bounds.hpp"
+#include "simd.hpp"
+#include "worker_pool.hpp"
+
+// Software occlusion culling on the CPU. The occluders (walls, buildings: closed, static, in
+// world space) are rasterized every frame into a small depth buffer, then the bounding box of
+// every instance is tested against it, so no GPU round trip is involved and the same code runs
+// on machines without one.
+//
+// The buffer stores 1/w (0 is empty, larger is closer), which interpolates linearly in screen
+// space. Rows are split in bands of OCCLUSION_TILE rows rasterized in parallel, four pixels at
+// a time with SSE2. Each 8x8 tile keeps its farthest depth, so most box tests are decided per
+// tile. Occluder triangles crossing the near plane are skipped and boxes crossing it are never
+// occluded. Pixels are covered when their center is, so an occluder may cover part of an edge
+// pixel only: boxes are tested over their pixels plus a one pixel border, which reaches past the
+// edge. The test stays conservative except for gaps narrower than a pixel between occluders.
+
+const unsigned int OCCLUSION_TILE = 8;
+
+class OcclusionBuffer
+{
+    public:
+        // the width must be a multiple of OCCLUSION_TILE (and so of the 4 SSE lanes), the height too
+        OcclusionBuffer(unsigned int width = 256, unsigned int height = 128) : width(width), height(height)
+        {
+            depth.resize(width * height);
+            tileFarthest.resize((width / OCCLUSION_TILE) * (height / OCCLUSION_TILE));
+        }
+
+        // adds the triangles of a closed mesh, in world space
+        void AddOccluder(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& triangles)
+        {
+            unsigned int base = (unsigned int)vertices.size();
+            vertices.insert(vertices.end(), positions.begin(), positions.end());
+            for (unsigned int i = 0; i < triangles.size(); i++)
+                indices.push_back(base + triangles[i]);
+            projected.resize(vertices.size());
+        }
+
+        void AddBox(const glm::vec3& min, const glm::vec3& max)
+        {
+            std::vector<glm::vec3> corners(8);
+            for (unsigned int i = 0; i < 8; i++)
+                corners[i] = glm::vec3(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z);
+            static const unsigned int faces[36] = {
+                0, 2, 1, 1, 2, 3,  4, 5, 6, 5, 7, 6,  0, 1, 4, 1, 5, 4,
+                2, 6, 3, 3, 6, 7,  0, 4, 2, 2, 4, 6,  1, 3, 5, 3, 7, 5
+            };
+            AddOccluder(corners, std::vector<unsigned int>(faces, faces + 36));
+        }
+
+        void ClearOccluders()
+        {
+            vertices.clear();
+            indices.clear();
+            projected.clear();
+        }
+
+        unsigned int GetNumTriangles() const { return (unsigned int)indices.size() / 3; }
+        unsigned int GetWidth() const { return width; }
+        unsigned int GetHeight() const { return height; }
+        // 1/w of the closest occluder at a pixel, 0 when there is none
+        float GetDepth(unsigned int x, unsigned int y) const { return depth[y * width + x]; }
+
+        // projects the occluders and rasterizes them, one band of tile rows per job of pool
+        void Render(const glm::mat4& viewProjection, WorkerPool& pool)
+        {
+            this->viewProjection = viewProjection;
+            for (unsigned int i = 0; i < vertices.size(); i++)
+                projected[i] = project(vertices[i]);
+
+            RasterizeBand job(*this);
+            pool.Run(height / OCCLUSION_TILE, job);
+        }
+
+        // true when the box (world space) is entirely behind the occluders of the last Render
+        bool IsOccluded(const BoundingBox& box) const
+        {
+            if (box.IsEmpty())
+                return false;
+            float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, nearest = 0.0f;
+            for (unsigned int i = 0; i < 8; i++)
+            {
+                glm::vec3 corner(i & 1 ? box.Max.x : box.Min.x, i & 2 ? box.Max.y : box.Min.y, i & 4 ? box.Max.z : box.Min.z);
+                glm::vec4 p = project(corner);
+                if (p.w == 0.0f)
+                    return false;
+                minX = std::min(minX, p.x);
+                maxX = std::max(maxX, p.x);
+                minY = std::min(minY, p.y);
+                maxY = std::max(maxY, p.y);
+                nearest = std::max(nearest, p.z);
+            }
+
+            // every pixel the box may touch and their neighbours, the parts off screen are left to the frustum test
+            int x0 = std::max(0, (int)std::floor(minX) - 1), x1 = std::min((int)width - 1, (int)std::floor(maxX) + 1);
+            int y0 = std::max(0, (int)std::floor(minY) - 1), y1 = std::min((int)height - 1, (int)std::floor(maxY) + 1);
+            if (x0 > x1 || y0 > y1)
+                return false;
+
+            unsigned int tilesPerRow = width / OCCLUSION_TILE;
+            for (int ty = y0 / (int)OCCLUSION_TILE; ty <= y1 / (int)OCCLUSION_TILE; ty++)
+            {
+                for (int tx = x0 / (int)OCCLUSION_TILE; tx <= x1 / (int)OCCLUSION_TILE; tx++)
+                {
+                    // the whole tile is closer than the box
+                    if (tileFarthest[ty * tilesPerRow + tx] > nearest)
+                        continue;
+                    int px0 = std::max(x0, tx * (int)OCCLUSION_TILE), px1 = std::min(x1, tx * (int)OCCLUSION_TILE + (int)OCCLUSION_TILE - 1);
+                    int py0 = std::max(y0, ty * (int)OCCLUSION_TILE), py1 = std::min(y1, ty * (int)OCCLUSION_TILE + (int)OCCLUSION_TILE - 1);
+                    for (int y = py0; y <= py1; y++)
+                        for (int x = px0; x <= px1; x++)
+                            if (depth[y * width + x] <= nearest)
+                                return false;
+                }
+            }
+            return true;
+        }
+
+    private:
+        unsigned int width, height;
+        std::vector<glm::vec3> vertices;
+        std::vector<unsigned int> indices;
+        // per vertex: pixel x, y, 1/w and 1, or all 0 behind the near plane
+        std::vector<glm::vec4> projected;
+        std::vector<float> depth;
+        // farthest (smallest) 1/w of each tile
+        std::vector<float> tileFarthest;
+        glm::mat4 viewProjection;
+
+        struct RasterizeBand
+        {
+            OcclusionBuffer& buffer;
+
+            explicit RasterizeBand(OcclusionBuffer& buffer) : buffer(buffer) {}
+
+            void operator()(unsigned int band) const { buffer.rasterizeBand(band); }
+        };
+
+        glm::vec4 project(const glm::vec3& position) const
+        {
+            glm::vec4 clip = viewProjection * glm::vec4(position, 1.0f);
+            if (clip.w < 1e-3f)
+                return glm::vec4(0.0f);
+            float inverseW = 1.0f / clip.w;
+            return glm::vec4((clip.x * inverseW * 0.5f + 0.5f) * width, (clip.y * inverseW * 0.5f + 0.5f) * height, inverseW, 1.0f);
+        }
+
+        void rasterizeBand(unsigned int band)
+        {
+            int bandY0 = (int)(band * OCCLUSION_TILE), bandY1 = bandY0 + (int)OCCLUSION_TILE - 1;
+            std::fill(depth.begin() + bandY0 * width, depth.begin() + (bandY1 + 1) * width, 0.0f);
+
+            for (unsigned int i = 0; i + 2 < indices.size(); i += 3)
+            {
+                glm::vec4 v0 = projected[indices[i]], v1 = projected[indices[i + 1]], v2 = projected[indices[i + 2]];
+                if (v0.w == 0.0f || v1.w == 0.0f || v2.w == 0.0f)
+                    continue;
+                float minY = std::min(v0.y, std::min(v1.y, v2.y)), maxY = std::max(v0.y, std::max(v1.y, v2.y));
+                if (maxY < bandY0 || minY > bandY1 + 1)
+                    continue;
+                rasterizeTriangle(v0, v1, v2, bandY0, bandY1);
+            }
+
+            unsigned int tilesPerRow = width / OCCLUSION_TILE;
+            for (unsigned int tx = 0; tx < tilesPerRow; tx++)
+            {
+                float farthest = 1e30f;
+                for (int y = bandY0; y <= bandY1; y++)
+                    for (unsigned int x = tx * OCCLUSION_TILE; x < (tx + 1) * OCCLUSION_TILE; x++)
+                        farthest = std::min(farthest, depth[y * width + x]);
+                tileFarthest[band * tilesPerRow + tx] = farthest;
+            }
+        }
+
+        // edge functions sampled at pixel centers, both windings are filled
+        void rasterizeTriangle(glm::vec4 v0, glm::vec4 v1, glm::vec4 v2, int bandY0, int bandY1)
+        {
+            float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+            if (area == 0.0f)
+                return;
+            if (area < 0.0f)
+            {
+                std::swap(v1, v2);
+                area = -area;
+            }
+
+            int x0 = std::max(0, (int)std::floor(std::min(v0.x, std::min(v1.x, v2.x))));
+            int x1 = std::min((int)width - 1, (int)std::floor(std::max(v0.x, std::max(v1.x, v2.x))));
+            int y0 = std::max(bandY0, (int)std::floor(std::min(v0.y, std::min(v1.y, v2.y))));
+            int y1 = std::min(bandY1, (int)std::floor(std::max(v0.y, std::max(v1.y, v2.y))));
+            if (x0 > x1 || y0 > y1)
+                return;
+
+            // E(x, y) = A x + B y + C, positive inside
+            const glm::vec4* corners[3] = { &v0, &v1, &v2 };
+            float a[3], b[3], c[3];
+            for (unsigned int e = 0; e < 3; e++)
+            {
+                const glm::vec4& from = *corners[e];
+                const glm::vec4& to = *corners[(e + 1) % 3];
+                a[e] = -(to.y - from.y);
+                b[e] = to.x - from.x;
+                c[e] = -(a[e] * from.x + b[e] * from.y);
+            }
+            // 1/w as a plane over the screen
+            float dzdx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+            float dzdy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+            float z0 = v0.z - dzdx * v0.x - dzdy * v0.y;
+
+            int start = x0 & ~3;
+#ifdef SKANIM_SSE2
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 lane = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+            __m128 a0 = _mm_set1_ps(a[0]), a1 = _mm_set1_ps(a[1]), a2 = _mm_set1_ps(a[2]), dx = _mm_set1_ps(dzdx);
+            for (int y = y0; y <= y1; y++)
+            {
+                float py = y + 0.5f;
+                __m128 row0 = _mm_set1_ps(b[0] * py + c[0]), row1 = _mm_set1_ps(b[1] * py + c[1]), row2 = _mm_set1_ps(b[2] * py + c[2]);
+                __m128 rowZ = _mm_set1_ps(dzdy * py + z0);
+                float* line = &depth[y * width];
+                for (int x = start; x <= x1; x += 4)
+                {
+                    __m128 px = _mm_add_ps(_mm_set1_ps((float)x), lane);
+                    __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), row0), zero),
+                                                          _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), row1), zero)),
+                                               _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), row2), zero));
+                    if (_mm_movemask_ps(inside) == 0)
+                        continue;
+                    __m128 z = _mm_add_ps(_mm_mul_ps(dx, px), rowZ);
+                    __m128 old = _mm_loadu_ps(line + x);
+                    _mm_storeu_ps(line + x, _mm_or_ps(_mm_and_ps(inside, _mm_max_ps(old, z)), _mm_andnot_ps(inside, old)));
+                }
+            }
+#else
+            for (int y = y0; y <= y1; y++)
+            {
+                float py = y + 0.5f;
+                float* line = &depth[y * width];
+                for (int x = start; x <= x1; x++)
+                {
+                    float px = x + 0.5f;
+                    if (a[0] * px + b[0] * py + c[0] < 0.0f || a[1] * px + b[1] * py + c[1] < 0.0f || a[2] * px + b[2] * py + c[2] < 0.0f)
+                        continue;
+                    line[x] = std::max(line[x], dzdx * px + dzdy * py + z0);
+                }
+            }
+#endif
+        }
+};
+
+namespace Occlusion
+{
+    // thin walls scattered over a square scene of the given extent centred on the origin, as the
+    // occluders of the benchmark scenes. Each is 2 to 6 spacings long and runs along x or z.
+    inline std::vector<BoundingBox> ScatterWalls(unsigned int count, float extent, float spacing, float height, unsigned int seed)
+    {
+        std::vector<BoundingBox> walls;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            float values[4];
+            for (unsigned int v = 0; v < 4; v++)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                values[v] = (float)(seed >> 8) / (float)(1 << 24);
+            }
+            glm::vec3 center((values[0] - 0.5f) * extent, height * 0.5f, (values[1] - 0.5f) * extent);
+            float length = (2.0f + values[2] * 4.0f) * spacing;
+            glm::vec3 half = values[3] < 0.5f ? glm::vec3(length * 0.5f, height * 0.5f, spacing * 0.1f)
+                                              : glm::vec3(spacing * 0.1f, height * 0.5f, length * 0.5f);
+            walls.push_back(BoundingBox(center - half, center + half));
+        }
+        return walls;
+    }
+}
+
+#endif
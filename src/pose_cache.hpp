@@ -0,0 +1,125 @@
+#ifndef POSE_CACHE_H
+#define POSE_CACHE_H
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "animation.hpp"
+#include "frame_stats.hpp"
+
+// Poses shared by the instances of a crowd playing the same clip at nearly the same phase.
+// Every frame, the instances due for an evaluation look up a key made of their model, clip,
+// skeleton LOD and clip time rounded down to a step. The first instance with a key evaluates
+// the pose at the rounded time, and the others with the same key copy its palette. A horde
+// playing a handful of clips then evaluates a few dozen poses a frame, whatever its size. The
+// step trades accuracy for hits: instances sharing a key show the pose of up to a step earlier.
+//
+// The table is open addressed and stamped with the frame, so starting a frame clears it
+// without touching the entries.
+
+inline uint64_t MakePoseCacheKey(unsigned int model, unsigned int clip, unsigned int skeletonLod, unsigned int step)
+{
+    return ((uint64_t)model & 0xFFFF) << 48 | ((uint64_t)clip & 0xFFF) << 36 | ((uint64_t)skeletonLod & 0xF) << 32 | (uint64_t)step;
+}
+
+class PoseCache
+{
+    public:
+        PoseCache() : step(0.0f), generation(0), mask(0), frameLookups(0), frameHits(0), lookups(0), hits(0), frames(0) {}
+
+        // seconds of clip time a key covers, 0 disables the cache
+        void SetStep(float seconds) { step = seconds > 0.0f ? seconds : 0.0f; }
+        float GetStep() const { return step; }
+        bool IsEnabled() const { return step > 0.0f; }
+
+        // step of clip the time (in seconds) falls in, and the start of that step in the first loop of the clip
+        unsigned int Quantize(const AnimationClip& clip, float timeInSeconds, float& quantizedSeconds) const
+        {
+            float ticks = Animation::ClipTime(clip, timeInSeconds);
+            unsigned int index = (unsigned int)(ticks / (step * clip.TicksPerSecond));
+            quantizedSeconds = index * step;
+            return index;
+        }
+
+        // empties the table, which gets room for lookups keys
+        void BeginFrame(unsigned int lookups)
+        {
+            size_t size = 16;
+            while (size < (size_t)lookups * 2)
+                size *= 2;
+            if (size > slots.size())
+            {
+                slots.assign(size, Slot());
+                generation = 0;
+            }
+            mask = slots.size() - 1;
+            generation++;
+            frameLookups = 0;
+            frameHits = 0;
+        }
+
+        // the source of key this frame: the first instance that looked it up, which evaluates the pose
+        unsigned int Find(uint64_t key, unsigned int instance)
+        {
+            frameLookups++;
+            size_t index = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+            while (slots[index].Generation == generation)
+            {
+                if (slots[index].Key == key)
+                {
+                    frameHits++;
+                    return slots[index].Source;
+                }
+                index = (index + 1) & mask;
+            }
+            slots[index].Key = key;
+            slots[index].Source = instance;
+            slots[index].Generation = generation;
+            return instance;
+        }
+
+        void EndFrame()
+        {
+            lookups += frameLookups;
+            hits += frameHits;
+            frames++;
+            FRAME_STAT_ADD(COUNTER_POSE_CACHE_HITS, frameHits);
+            FRAME_STAT_ADD(COUNTER_POSE_CACHE_MISSES, frameLookups - frameHits);
+        }
+
+        uint64_t GetLookups() const { return lookups; }
+        uint64_t GetHits() const { return hits; }
+
+        void PrintSummary(std::ostream& out) const
+        {
+            if (!IsEnabled() || frames == 0)
+                return;
+            out << "Pose cache: step " << step << " s, " << (double)(lookups - hits) / frames << " poses evaluated per frame for "
+                << (double)lookups / frames << " instances, " << (lookups > 0 ? 100.0 * hits / lookups : 0.0) << "% hits" << std::endl;
+        }
+
+    private:
+        struct Slot
+        {
+            uint64_t Key;
+            unsigned int Source;
+            // of the frame that wrote the slot, an older one means empty
+            unsigned int Generation;
+
+            Slot() : Key(0), Source(0), Generation(0) {}
+        };
+
+        float step;
+        std::vector<Slot> slots;
+        unsigned int generation;
+        size_t mask;
+        uint64_t frameLookups;
+        uint64_t frameHits;
+        uint64_t lookups;
+        uint64_t hits;
+        unsigned int frames;
+};
+
+#endif
@@ -0,0 +1,296 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+// Hierarchical frame profiler. CPU zones are recorded by PROFILE_SCOPE, GPU zones by
+// PROFILE_GPU_SCOPE with GL_TIME_ELAPSED queries that are read back a few frames later, so
+// the CPU never waits for the GPU. The capture is written as a chrome://tracing / Perfetto
+// JSON file.
+//
+// Without SKANIM_PROFILER the macros expand to nothing; with it, a disabled profiler costs
+// one relaxed atomic load per zone.
+
+struct ProfileEvent
+{
+    const char* Name;
+    int64_t Start;    // nanoseconds since the profiler was created
+    int64_t Duration; // nanoseconds
+    uint32_t Thread;
+    uint32_t Depth;
+};
+
+class Profiler
+{
+    public:
+        // GPU zones are resolved this many frames after they were issued
+        static const unsigned int GPU_FRAME_LATENCY = 3;
+        static const unsigned int MAX_GPU_ZONES_PER_FRAME = 16;
+        // thread id used for the GPU track in the trace
+        static const uint32_t GPU_THREAD = 1000;
+
+        static Profiler& Get()
+        {
+            static Profiler instance;
+            return instance;
+        }
+
+        // allocates the event buffer up front, so recording never allocates
+        void Init(size_t capacity = 1 << 16)
+        {
+            events.resize(capacity);
+            count.store(0);
+            dropped.store(0);
+        }
+
+        void SetEnabled(bool enable)
+        {
+            if (enable && events.empty())
+                Init();
+            enabled.store(enable, std::memory_order_relaxed);
+        }
+
+        bool IsEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+        int64_t Now() const
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+        }
+
+        void Record(const char* name, int64_t start, int64_t end, uint32_t thread, uint32_t depth)
+        {
+            size_t slot = count.fetch_add(1, std::memory_order_relaxed);
+            if (slot >= events.size())
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            ProfileEvent& event = events[slot];
+            event.Name = name;
+            event.Start = start;
+            event.Duration = end - start;
+            event.Thread = thread;
+            event.Depth = depth;
+        }
+
+        // forgets the recorded events, e.g. to start a new capture
+        void Clear()
+        {
+            count.store(0);
+            dropped.store(0);
+        }
+
+        size_t GetNumEvents() const
+        {
+            size_t recorded = count.load();
+            return recorded < events.size() ? recorded : events.size();
+        }
+        size_t GetDroppedEvents() const { return dropped.load(); }
+        const ProfileEvent& GetEvent(size_t index) const { return events[index]; }
+
+        // small stable id for the calling thread
+        static uint32_t ThreadID()
+        {
+            static std::atomic<uint32_t> nextThread(0);
+            static thread_local uint32_t thread = nextThread.fetch_add(1);
+            return thread;
+        }
+
+        // nesting depth of the CPU zones open on the calling thread
+        static uint32_t& ThreadDepth()
+        {
+            static thread_local uint32_t depth = 0;
+            return depth;
+        }
+
+        // call once per frame on the render thread: collects the GPU timings that are ready by now
+        void BeginFrame()
+        {
+            if (!gpuInitialized)
+                return;
+
+            gpuFrame = (gpuFrame + 1) % GPU_FRAME_LATENCY;
+            for (unsigned int i = 0; i < MAX_GPU_ZONES_PER_FRAME; i++)
+            {
+                GpuZone& zone = gpuZones[gpuFrame][i];
+                if (!zone.Pending)
+                    continue;
+                GLint available = 0;
+                glGetQueryObjectiv(zone.Query, GL_QUERY_RESULT_AVAILABLE, &available);
+                // still in flight: keep it pending and use another slot rather than stall
+                if (!available)
+                    continue;
+                GLuint64 elapsed = 0;
+                glGetQueryObjectui64v(zone.Query, GL_QUERY_RESULT, &elapsed);
+                zone.Pending = false;
+                if (IsEnabled())
+                    Record(zone.Name, zone.CpuStart, zone.CpuStart + (int64_t)elapsed, GPU_THREAD, 0);
+            }
+        }
+
+        // GL_TIME_ELAPSED queries can't nest: a GPU zone opened inside another one is ignored
+        void BeginGpuZone(const char* name)
+        {
+            if (!IsEnabled() || activeGpuZone != nullptr)
+                return;
+            if (!gpuInitialized)
+                initGpu();
+
+            for (unsigned int i = 0; i < MAX_GPU_ZONES_PER_FRAME; i++)
+            {
+                GpuZone& zone = gpuZones[gpuFrame][i];
+                if (zone.Pending)
+                    continue;
+                zone.Name = name;
+                zone.CpuStart = Now();
+                glBeginQuery(GL_TIME_ELAPSED, zone.Query);
+                activeGpuZone = &zone;
+                return;
+            }
+        }
+
+        void EndGpuZone()
+        {
+            if (activeGpuZone == nullptr)
+                return;
+            glEndQuery(GL_TIME_ELAPSED);
+            activeGpuZone->Pending = true;
+            activeGpuZone = nullptr;
+        }
+
+        // releases the query objects while the GL context is still alive
+        void Shutdown()
+        {
+            if (!gpuInitialized)
+                return;
+            for (unsigned int f = 0; f < GPU_FRAME_LATENCY; f++)
+                for (unsigned int i = 0; i < MAX_GPU_ZONES_PER_FRAME; i++)
+                    glDeleteQueries(1, &gpuZones[f][i].Query);
+            gpuInitialized = false;
+        }
+
+        // writes the recorded events in the Trace Event Format (chrome://tracing, ui.perfetto.dev)
+        bool WriteChromeTrace(const std::string& path) const
+        {
+            std::ofstream file(path.c_str());
+            if (!file)
+            {
+                std::cout << "ERROR::PROFILER: Failed to write " << path << std::endl;
+                return false;
+            }
+
+            // nanoseconds written as microseconds, without the exponent the default formatting uses past 6 digits
+            file << std::fixed << std::setprecision(3);
+            file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+            file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << GPU_THREAD << ",\"args\":{\"name\":\"GPU\"}}";
+            size_t numEvents = GetNumEvents();
+            for (size_t i = 0; i < numEvents; i++)
+            {
+                const ProfileEvent& event = events[i];
+                file << ",\n{\"name\":\"" << event.Name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.Thread
+                     << ",\"ts\":" << event.Start / 1000.0 << ",\"dur\":" << event.Duration / 1000.0
+                     << ",\"args\":{\"depth\":" << event.Depth << "}}";
+            }
+            file << "\n]}\n";
+
+            std::cout << "Profiler: wrote " << numEvents << " events to " << path;
+            if (GetDroppedEvents() > 0)
+                std::cout << " (" << GetDroppedEvents() << " dropped, buffer full)";
+            std::cout << std::endl;
+            return true;
+        }
+
+    private:
+        struct GpuZone
+        {
+            GLuint Query;
+            const char* Name;
+            int64_t CpuStart;
+            bool Pending;
+        };
+
+        std::chrono::steady_clock::time_point origin;
+        std::atomic<bool> enabled;
+        std::vector<ProfileEvent> events;
+        std::atomic<size_t> count;
+        std::atomic<size_t> dropped;
+
+        GpuZone gpuZones[GPU_FRAME_LATENCY][MAX_GPU_ZONES_PER_FRAME];
+        GpuZone* activeGpuZone;
+        unsigned int gpuFrame;
+        bool gpuInitialized;
+
+        Profiler() : origin(std::chrono::steady_clock::now()), enabled(false), count(0), dropped(0),
+            activeGpuZone(nullptr), gpuFrame(0), gpuInitialized(false) {}
+        Profiler(const Profiler&);
+        Profiler& operator=(const Profiler&);
+
+        void initGpu()
+        {
+            for (unsigned int f = 0; f < GPU_FRAME_LATENCY; f++)
+            {
+                for (unsigned int i = 0; i < MAX_GPU_ZONES_PER_FRAME; i++)
+                {
+                    glGenQueries(1, &gpuZones[f][i].Query);
+                    gpuZones[f][i].Name = nullptr;
+                    gpuZones[f][i].CpuStart = 0;
+                    gpuZones[f][i].Pending = false;
+                }
+            }
+            gpuInitialized = true;
+        }
+};
+
+// Records the lifetime of the scope as a CPU zone
+class ProfileScope
+{
+    public:
+        explicit ProfileScope(const char* name) : name(name), start(-1)
+        {
+            if (!Profiler::Get().IsEnabled())
+                return;
+            start = Profiler::Get().Now();
+            Profiler::ThreadDepth()++;
+        }
+
+        ~ProfileScope()
+        {
+            if (start < 0)
+                return;
+            uint32_t depth = --Profiler::ThreadDepth();
+            Profiler::Get().Record(name, start, Profiler::Get().Now(), Profiler::ThreadID(), depth);
+        }
+
+    private:
+        const char* name;
+        int64_t start;
+};
+
+// Times the GL commands issued in the scope on the GPU
+class GpuProfileScope
+{
+    public:
+        explicit GpuProfileScope(const char* name) { Profiler::Get().BeginGpuZone(name); }
+        ~GpuProfileScope() { Profiler::Get().EndGpuZone(); }
+};
+
+#ifdef SKANIM_PROFILER
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name) GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_GPU_SCOPE(name)
+#endif
+
+#endif
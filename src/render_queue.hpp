@@ -0,0 +1,168 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "gl_state_cache.hpp"
+#include "mesh.hpp"
+#include "profiler.hpp"
+#include "shader.hpp"
+
+// Draw packets sorted by a 64-bit key before they are submitted, so the draws sharing a program,
+// a material and a vertex array follow each other and the state cache drops the repeated binds.
+// The keys are radix sorted, eight bits at a time, skipping the bytes every key has in common.
+// The queue keeps its buffers between frames, so it stops allocating once it has seen the
+// largest frame.
+
+enum class RenderPass
+{
+    Opaque,     // front to back
+    Transparent // back to front
+};
+
+// Key bits, from the most significant: pass (4), program (8), material (16), depth (20) and
+// vertex array (16). Depth comes before the vertex array so the meshes of one character stay
+// together and its bone palette is bound once, not once per mesh. depth is the distance to
+// the camera over the far plane. Programs, materials and vertex arrays are dense indices the
+// caller numbers from 0, not GL names, which can grow past the bits of their field; indices
+// past the limits below share their key bits with smaller ones and sort together.
+const unsigned int SORT_KEY_PROGRAMS = 1u << 8;
+const unsigned int SORT_KEY_MATERIALS = 1u << 16;
+const unsigned int SORT_KEY_VERTEX_ARRAYS = 1u << 16;
+
+inline uint64_t MakeSortKey(RenderPass pass, unsigned int program, unsigned int material, float depth, unsigned int vertexArray)
+{
+    const uint64_t depthMax = (1u << 20) - 1;
+    uint64_t depthBits = (uint64_t)(std::min(std::max(depth, 0.0f), 1.0f) * depthMax);
+    if (pass == RenderPass::Transparent)
+        depthBits = depthMax - depthBits;
+    return ((uint64_t)pass & 0xF) << 60 | ((uint64_t)program & (SORT_KEY_PROGRAMS - 1)) << 52 |
+           ((uint64_t)material & (SORT_KEY_MATERIALS - 1)) << 36 | depthBits << 16 | ((uint64_t)vertexArray & (SORT_KEY_VERTEX_ARRAYS - 1));
+}
+
+struct DrawPacket
+{
+    uint64_t Key;
+    const Mesh* DrawMesh;
+    unsigned int Lod;
+    // bound to unit 0 before the textures of the mesh, 0 for none
+    GLuint Texture;
+    const glm::mat4* Transform;
+    // buffer and offset of the bone palette, buffer 0 for a static mesh
+    GLuint PaletteBuffer;
+    GLintptr PaletteOffset;
+};
+
+class RenderQueue
+{
+    public:
+        RenderQueue() : sorted(false) {}
+
+        void Clear()
+        {
+            packets.clear();
+            sorted = false;
+        }
+
+        void Push(const DrawPacket& packet)
+        {
+            packets.push_back(packet);
+            sorted = false;
+        }
+
+        unsigned int GetNumPackets() const { return (unsigned int)packets.size(); }
+
+        // orders the packets by key, the ones with equal keys keep their push order
+        void Sort()
+        {
+            PROFILE_SCOPE("RenderQueue::Sort");
+            unsigned int count = (unsigned int)packets.size();
+            order.resize(count);
+            scratch.resize(count);
+            for (unsigned int i = 0; i < count; i++)
+            {
+                order[i].Key = packets[i].Key;
+                order[i].Index = i;
+            }
+
+            // one histogram per byte, all filled in a single pass
+            unsigned int histograms[8][256];
+            std::fill(&histograms[0][0], &histograms[0][0] + 8 * 256, 0u);
+            for (unsigned int i = 0; i < count; i++)
+                for (unsigned int byte = 0; byte < 8; byte++)
+                    histograms[byte][(order[i].Key >> (byte * 8)) & 0xFF]++;
+
+            for (unsigned int byte = 0; byte < 8; byte++)
+            {
+                unsigned int* histogram = histograms[byte];
+                unsigned int shift = byte * 8;
+                // every key has the same byte here
+                if (count == 0 || histogram[(order[0].Key >> shift) & 0xFF] == count)
+                    continue;
+                unsigned int offset = 0;
+                for (unsigned int digit = 0; digit < 256; digit++)
+                {
+                    unsigned int digitCount = histogram[digit];
+                    histogram[digit] = offset;
+                    offset += digitCount;
+                }
+                for (unsigned int i = 0; i < count; i++)
+                    scratch[histogram[(order[i].Key >> shift) & 0xFF]++] = order[i];
+                order.swap(scratch);
+            }
+            sorted = true;
+        }
+
+        // draws the packets, in key order after Sort and in push order otherwise. paletteBase is added
+        // to the palette offsets of the packets. The state cache starts empty since the code outside
+        // the queue binds without it.
+        void Submit(const Shader& shader, GLintptr paletteBase = 0)
+        {
+            PROFILE_SCOPE("RenderQueue::Submit");
+            state.Invalidate();
+            state.UseProgram(shader.ID);
+            const glm::mat4* transform = nullptr;
+            int animated = -1;
+            for (unsigned int i = 0; i < packets.size(); i++)
+            {
+                const DrawPacket& packet = packets[sorted ? order[i].Index : i];
+                state.BindTexture(0, packet.Texture);
+                if (packet.Transform != transform)
+                {
+                    transform = packet.Transform;
+                    shader.SetMatrix4("model", *transform);
+                }
+                int packetAnimated = packet.PaletteBuffer != 0 ? 1 : 0;
+                if (packetAnimated != animated)
+                {
+                    animated = packetAnimated;
+                    shader.SetInteger("animated", animated);
+                }
+                if (packet.PaletteBuffer != 0)
+                    state.BindUniformBuffer(BONES_BLOCK_BINDING, packet.PaletteBuffer, paletteBase + packet.PaletteOffset, BONES_BLOCK_BYTES);
+                packet.DrawMesh->Draw(shader, packet.Lod, state);
+            }
+            state.Reset();
+        }
+
+    private:
+        struct SortEntry
+        {
+            uint64_t Key;
+            unsigned int Index;
+        };
+
+        std::vector<DrawPacket> packets;
+        std::vector<SortEntry> order;
+        std::vector<SortEntry> scratch;
+        bool sorted;
+        GLStateCache state;
+};
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef ROOT_MOTION_H
+#define ROOT_MOTION_H
+
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include "animation.hpp"
+
+// Root motion taken out of a clip at import. The root joint is the shallowest joint the clip
+// moves. Its motion over the ground (model space X and Z) and its turn around the up axis (Y)
+// are written to a small track: one key per position key of the root, holding the translation
+// and the yaw since the first key. Then they are removed from the root's keys, so the clip plays
+// in place. Gameplay and crowd steering read the displacement between two times from the track
+// alone, without sampling the hierarchy. Moving the character by it gives back the original motion.
+
+struct RootMotionKey
+{
+    float Time; // ticks
+    // since the first key, in model space
+    glm::vec3 Translation;
+    float Yaw;
+};
+
+// motion between two times, in the model space of the first one
+struct RootMotionDelta
+{
+    glm::vec3 Translation;
+    float Yaw;
+
+    RootMotionDelta() : Translation(0.0f), Yaw(0.0f) {}
+    RootMotionDelta(const glm::vec3& translation, float yaw) : Translation(translation), Yaw(yaw) {}
+};
+
+struct RootMotionTrack
+{
+    // the joint the motion was taken from, -1 when the clip has none
+    int Joint;
+    float Duration;
+    float TicksPerSecond;
+    // where the root stands on the ground at the first key, the turns are around it
+    glm::vec3 Pivot;
+    std::vector<RootMotionKey> Keys;
+
+    RootMotionTrack() : Joint(-1), Duration(0.0f), TicksPerSecond(25.0f), Pivot(0.0f) {}
+
+    bool IsEmpty() const { return Keys.empty(); }
+
+    size_t GetCPUBytes() const { return sizeof(RootMotionTrack) + Keys.capacity() * sizeof(RootMotionKey); }
+};
+
+namespace RootMotion
+{
+    // rotates v by yaw radians around the up axis
+    inline glm::vec3 rotateYaw(const glm::vec3& v, float yaw)
+    {
+        float c = std::cos(yaw), s = std::sin(yaw);
+        return glm::vec3(c * v.x + s * v.z, v.y, -s * v.x + c * v.z);
+    }
+
+    // b after a
+    inline RootMotionDelta Compose(const RootMotionDelta& a, const RootMotionDelta& b)
+    {
+        return RootMotionDelta(a.Translation + rotateYaw(b.Translation, a.Yaw), a.Yaw + b.Yaw);
+    }
+
+    // the shallowest joint with moving position keys, -1 if none
+    inline int FindRootJoint(const Skeleton& skeleton, const AnimationClip& clip)
+    {
+        int root = -1;
+        unsigned int rootDepth = 0;
+        for (unsigned int c = 0; c < clip.Channels.size(); c++)
+        {
+            const AnimationChannel& channel = clip.Channels[c];
+            if (channel.PositionKeys.size() < 2)
+                continue;
+            unsigned int depth = 0;
+            for (int j = skeleton.Joints[channel.Joint].Parent; j >= 0; j = skeleton.Joints[j].Parent)
+                depth++;
+            if (root < 0 || depth < rootDepth)
+            {
+                root = (int)channel.Joint;
+                rootDepth = depth;
+            }
+        }
+        return root;
+    }
+
+    // angle of the twist of q around the up axis
+    inline float yawOf(const glm::quat& q) { return 2.0f * std::atan2(q.y, q.w); }
+
+    // a, moved by whole turns to be the closest to previous
+    inline float unwrap(float a, float previous)
+    {
+        const float turn = 2.0f * glm::pi<float>();
+        while (a - previous > 0.5f * turn)
+            a -= turn;
+        while (a - previous < -0.5f * turn)
+            a += turn;
+        return a;
+    }
+
+    // linear in the yaw of the keys, which is unwrapped
+    inline float sampleYaw(const std::vector<QuatKey>& keys, const std::vector<float>& yaws, float time)
+    {
+        if (keys.size() == 1 || time <= keys[0].Time)
+            return yaws[0];
+        for (unsigned int k = 0; k + 1 < keys.size(); k++)
+            if (time < keys[k + 1].Time)
+            {
+                float factor = (time - keys[k].Time) / (keys[k + 1].Time - keys[k].Time);
+                return yaws[k] + factor * (yaws[k + 1] - yaws[k]);
+            }
+        return yaws.back();
+    }
+
+    // takes the ground motion and the turn of the root out of clip into the returned track. The
+    // joints above the root must not be animated, which holds since the root is the shallowest.
+    inline RootMotionTrack Extract(const Skeleton& skeleton, AnimationClip& clip)
+    {
+        RootMotionTrack track;
+        track.Duration = clip.Duration;
+        track.TicksPerSecond = clip.TicksPerSecond;
+        track.Joint = FindRootJoint(skeleton, clip);
+        if (track.Joint < 0)
+            return track;
+        AnimationChannel* channel = nullptr;
+        for (unsigned int c = 0; c < clip.Channels.size() && channel == nullptr; c++)
+            if (clip.Channels[c].Joint == (unsigned int)track.Joint)
+                channel = &clip.Channels[c];
+
+        // model space of the root's parent, in its bind pose
+        glm::mat4 parent(1.0f);
+        for (int j = skeleton.Joints[track.Joint].Parent; j >= 0; j = skeleton.Joints[j].Parent)
+            parent = skeleton.Joints[j].LocalTransform * parent;
+        parent = skeleton.GlobalInverseTransform * parent;
+        glm::mat3 linear(parent);
+        glm::mat3 toLocal = glm::inverse(linear);
+        // the rotation of the parent, whose scale is taken to be uniform
+        glm::quat parentRotation = glm::normalize(glm::quat_cast(linear * (1.0f / glm::length(linear[0]))));
+        glm::quat parentInverse = glm::inverse(parentRotation);
+
+        std::vector<float> yaws(channel->RotationKeys.size());
+        glm::quat first = parentRotation * channel->RotationKeys[0].Value;
+        for (unsigned int k = 0; k < channel->RotationKeys.size(); k++)
+        {
+            glm::quat rotation = parentRotation * channel->RotationKeys[k].Value;
+            float yaw = yawOf(rotation * glm::inverse(first));
+            yaws[k] = k == 0 ? 0.0f : unwrap(yaw, yaws[k - 1]);
+        }
+
+        glm::vec3 origin = linear * channel->PositionKeys[0].Value;
+        track.Pivot = glm::vec3(parent[3]) + origin;
+        track.Pivot.y = 0.0f;
+        track.Keys.resize(channel->PositionKeys.size());
+        for (unsigned int k = 0; k < channel->PositionKeys.size(); k++)
+        {
+            VectorKey& key = channel->PositionKeys[k];
+            glm::vec3 ground = linear * key.Value - origin;
+            ground.y = 0.0f;
+            track.Keys[k].Time = key.Time;
+            track.Keys[k].Translation = ground;
+            track.Keys[k].Yaw = sampleYaw(channel->RotationKeys, yaws, key.Time);
+            key.Value -= toLocal * ground;
+        }
+        for (unsigned int k = 0; k < channel->RotationKeys.size(); k++)
+        {
+            glm::quat unturn = glm::angleAxis(-yaws[k], glm::vec3(0.0f, 1.0f, 0.0f));
+            QuatKey& key = channel->RotationKeys[k];
+            key.Value = glm::normalize(parentInverse * unturn * parentRotation * key.Value);
+        }
+        return track;
+    }
+
+    // the track at time (in ticks, within the clip)
+    inline RootMotionKey Sample(const RootMotionTrack& track, float time)
+    {
+        const std::vector<RootMotionKey>& keys = track.Keys;
+        if (keys.size() == 1 || time <= keys[0].Time)
+            return keys[0];
+        unsigned int k = 0;
+        while (k + 2 < keys.size() && time >= keys[k + 1].Time)
+            k++;
+        float factor = glm::clamp((time - keys[k].Time) / (keys[k + 1].Time - keys[k].Time), 0.0f, 1.0f);
+        RootMotionKey key;
+        key.Time = time;
+        key.Translation = keys[k].Translation + factor * (keys[k + 1].Translation - keys[k].Translation);
+        key.Yaw = keys[k].Yaw + factor * (keys[k + 1].Yaw - keys[k].Yaw);
+        return key;
+    }
+
+    // motion between two times of the same loop (in ticks)
+    inline RootMotionDelta deltaWithinLoop(const RootMotionTrack& track, float from, float to)
+    {
+        RootMotionKey a = Sample(track, from), b = Sample(track, to);
+        return RootMotionDelta(rotateYaw(b.Translation - a.Translation, -a.Yaw), b.Yaw - a.Yaw);
+    }
+
+    // motion from one time to a later one (in seconds), the clip looping in between
+    inline RootMotionDelta Between(const RootMotionTrack& track, float fromSeconds, float toSeconds)
+    {
+        float length = track.Duration / track.TicksPerSecond;
+        if (track.IsEmpty() || length <= 0.0f || toSeconds <= fromSeconds)
+            return RootMotionDelta();
+        float fromLoop = std::floor(fromSeconds / length), toLoop = std::floor(toSeconds / length);
+        float from = (fromSeconds - fromLoop * length) * track.TicksPerSecond;
+        float to = (toSeconds - toLoop * length) * track.TicksPerSecond;
+        if (fromLoop == toLoop)
+            return deltaWithinLoop(track, from, to);
+        RootMotionDelta delta = deltaWithinLoop(track, from, track.Duration);
+        RootMotionDelta loop = deltaWithinLoop(track, 0.0f, track.Duration);
+        for (float l = fromLoop + 1.0f; l < toLoop; l += 1.0f)
+            delta = Compose(delta, loop);
+        return Compose(delta, deltaWithinLoop(track, 0.0f, to));
+    }
+
+    // the model transform moved by delta, turning around the pivot of the track
+    inline glm::mat4 Apply(const RootMotionTrack& track, const glm::mat4& transform, const RootMotionDelta& delta)
+    {
+        glm::mat4 moved = glm::translate(transform, track.Pivot + delta.Translation);
+        moved = glm::rotate(moved, delta.Yaw, glm::vec3(0.0f, 1.0f, 0.0f));
+        return glm::translate(moved, -track.Pivot);
+    }
+}
+
+#endif
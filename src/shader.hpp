@@ -11,6 +11,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "frame_stats.hpp"
+
 class Shader
 {
     public:
@@ -57,8 +59,9 @@ class Shader
             Compile(vShaderCode, fShaderCode, gShaderFilename != nullptr ? gShaderCode : nullptr);
         }
 
-        Shader &Use()
+        const Shader &Use() const
         {
+            FRAME_STAT_ADD(COUNTER_STATE_CHANGES, 1);
             glUseProgram(ID);
             return *this;
         }
@@ -99,77 +102,106 @@ class Shader
                 glDeleteShader(gShader);
         }
 
-        void SetFloat(const std::string& name, GLfloat value, GLboolean useShader = false)
+        void SetFloat(const GLchar* name, GLfloat value, GLboolean useShader = false) const
         {
             if (useShader)
                 Use();
-            glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+            countUpload(sizeof(GLfloat));
+            glUniform1f(glGetUniformLocation(ID, name), value);
         }
 
-        void SetInteger(const std::string& name, GLint value, GLboolean useShader = false)
+        void SetInteger(const GLchar* name, GLint value, GLboolean useShader = false) const
         {
             if (useShader)
                 Use();
-            glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+            countUpload(sizeof(GLint));
+            glUniform1i(glGetUniformLocation(ID, name), value);
         }
 
-        void SetVector2f(const std::string& name, GLfloat x, GLfloat y, GLboolean useShader = false)
+        void SetVector2f(const GLchar* name, GLfloat x, GLfloat y, GLboolean useShader = false) const
         {
             if (useShader)
                 Use();
-            glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+            countUpload(2 * sizeof(GLfloat));
+            glUniform2f(glGetUniformLocation(ID, name), x, y);
         }
 
-        void SetVector2f(const std::string& name, const glm::vec2& value, GLboolean useShader = false)
+        void SetVector2f(const GLchar* name, const glm::vec2& value, GLboolean useShader = false) const
         {
             if (useShader)
                 Use();
-            glUniform2f(glGetUniformLocation(ID, name.c_str()), value.x, value.y);
+            countUpload(2 * sizeof(GLfloat));
+            glUniform2f(glGetUniformLocation(ID, name), value.x, value.y);
         }
 
-        void SetVector3f(const std::string& name, GLfloat x, GLfloat y, GLfloat z, GLboolean useShader = false)
+        void SetVector3f(const GLchar* name, GLfloat x, GLfloat y, GLfloat z, GLboolean useShader = false) const
         {
             if (useShader)
                 Use();
-            glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+            countUpload(3 * sizeof(GLfloat));
+            glUniform3f(glGetUniformLocation(ID, name), x, y, z);
         }
 
-        void SetVector3f(const std::string& name, const glm::vec3& value, GLboolean useShader = false)
+        void SetVector3f(const GLchar* name, const glm::vec3& value, GLboolean useShader = false) const
         {
             if (useShader)
                 Use();
-            glUniform3f(glGetUniformLocation(ID, name.c_str()), value.x, value.y, value.z);
+            countUpload(3 * sizeof(GLfloat));
+            glUniform3f(glGetUniformLocation(ID, name), value.x, value.y, value.z);
         }
 
-        void SetVector4f(const std::string& name, GLfloat x, GLfloat y, GLfloat z, GLfloat w, GLboolean useShader = false)
+        void SetVector4f(const GLchar* name, GLfloat x, GLfloat y, GLfloat z, GLfloat w, GLboolean useShader = false) const
         {
             if (useShader)
                 Use();
-            glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+            countUpload(4 * sizeof(GLfloat));
+            glUniform4f(glGetUniformLocation(ID, name), x, y, z, w);
         }
 
-        void SetVector4f(const std::string& name, const glm::vec4& value, GLboolean useShader = false)
+        void SetVector4f(const GLchar* name, const glm::vec4& value, GLboolean useShader = false) const
         {
             if (useShader)
                 Use();
-            glUniform4f(glGetUniformLocation(ID, name.c_str()), value.x, value.y, value.z, value.w);
+            countUpload(4 * sizeof(GLfloat));
+            glUniform4f(glGetUniformLocation(ID, name), value.x, value.y, value.z, value.w);
         }
 
-        void SetMatrix4(const std::string& name, const glm::mat4& matrix, GLboolean useShader = false)
+        void SetMatrix4(const GLchar* name, const glm::mat4& matrix, GLboolean useShader = false) const
         {
             if (useShader)
                 Use();
-            glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(matrix));
+            countUpload(sizeof(glm::mat4));
+            glUniformMatrix4fv(glGetUniformLocation(ID, name), 1, GL_FALSE, glm::value_ptr(matrix));
         }
 
-        void SetMatrix4v(const std::string& name, const std::vector<glm::mat4>& matrices, GLboolean useShader = false)
+        void SetMatrix4v(const GLchar* name, const std::vector<glm::mat4>& matrices, GLboolean useShader = false) const
         {
             if (useShader)
                 Use();
-            glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), (GLsizei)matrices.size(), GL_FALSE, glm::value_ptr(matrices[0]));
+            countUpload(matrices.size() * sizeof(glm::mat4));
+            glUniformMatrix4fv(glGetUniformLocation(ID, name), (GLsizei)matrices.size(), GL_FALSE, glm::value_ptr(matrices[0]));
+        }
+
+        // attaches a uniform block of the program to a buffer binding point, once after linking
+        void BindUniformBlock(const GLchar* name, GLuint binding) const
+        {
+            GLuint index = glGetUniformBlockIndex(ID, name);
+            if (index == GL_INVALID_INDEX)
+            {
+                std::cout << "ERROR::SHADER: No uniform block " << name << std::endl;
+                return;
+            }
+            glUniformBlockBinding(ID, index, binding);
         }
 
     private:
+        static void countUpload(size_t bytes)
+        {
+            FRAME_STAT_ADD(COUNTER_UNIFORM_UPLOADS, 1);
+            FRAME_STAT_ADD(COUNTER_BYTES_UPLOADED, bytes);
+            (void)bytes;
+        }
+
         void checkCompileErrors(GLuint object, std::string type)
         {
             GLint success;
@@ -11,7 +11,11 @@ const int MAX_BONES = 100;
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
-uniform mat4 gBones[MAX_BONES];
+// bound to a range of the palette ring buffer, see frame_ring.hpp
+layout (std140) uniform Bones
+{
+    mat4 gBones[MAX_BONES];
+};
 uniform bool animated;
 
 out vec3 FragPos;
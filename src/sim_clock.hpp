@@ -0,0 +1,80 @@
+#ifndef SIM_CLOCK_H
+#define SIM_CLOCK_H
+
+#include <cmath>
+#include <cstdint>
+
+// Simulation clock feeding the animation time. Real time follows the wall clock. Fixed step
+// accumulates the wall time and advances in whole steps. Benchmark advances exactly one step
+// every frame, whatever the wall time, so the same frame always samples the same time.
+// In both stepped modes the time is computed as steps * step rather than summed, so it
+// doesn't drift and is bit for bit the same across runs and machines.
+
+enum class ClockMode
+{
+    RealTime,
+    FixedStep,
+    Benchmark
+};
+
+class SimulationClock
+{
+    public:
+        // steps a fixed-step clock may take in one frame before it drops time, so a long
+        // stall doesn't make the next frames even longer
+        static const unsigned int MAX_STEPS_PER_FRAME = 8;
+
+        SimulationClock(ClockMode mode = ClockMode::RealTime, double step = 1.0 / 60.0)
+            : mode(mode), step(step), steps(0), accumulator(0.0), lastWallTime(-1.0), time(0.0), deltaTime(0.0) {}
+
+        ClockMode GetMode() const { return mode; }
+        double GetStep() const { return step; }
+
+        // call once per frame with the current wall time, returns the number of steps taken (1 in real time)
+        unsigned int Advance(double wallTime)
+        {
+            double wallDelta = lastWallTime >= 0.0 ? wallTime - lastWallTime : 0.0;
+            lastWallTime = wallTime;
+            double previous = time;
+            unsigned int taken = 1;
+
+            if (mode == ClockMode::RealTime)
+                time = wallTime;
+            else if (mode == ClockMode::Benchmark)
+                time = (double)++steps * step;
+            else
+            {
+                accumulator += wallDelta;
+                taken = 0;
+                while (accumulator >= step && taken < MAX_STEPS_PER_FRAME)
+                {
+                    accumulator -= step;
+                    taken++;
+                }
+                // drops the whole steps left over, keeping the fraction of a step
+                if (taken == MAX_STEPS_PER_FRAME)
+                    accumulator = std::fmod(accumulator, step);
+                steps += taken;
+                time = (double)steps * step;
+            }
+            deltaTime = time - previous;
+            return taken;
+        }
+
+        // simulation time in seconds
+        double GetTime() const { return time; }
+        double GetDeltaTime() const { return deltaTime; }
+        // fraction of a step left in the accumulator, to interpolate between two fixed steps
+        double GetAlpha() const { return mode == ClockMode::FixedStep ? accumulator / step : 0.0; }
+
+    private:
+        ClockMode mode;
+        double step;
+        uint64_t steps;
+        double accumulator;
+        double lastWallTime;
+        double time;
+        double deltaTime;
+};
+
+#endif
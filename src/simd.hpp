@@ -0,0 +1,12 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// SKANIM_SSE2 is defined when the compiler targets SSE2 (always on x86-64), and the code paths
+// that use the intrinsics fall back to scalar code without it.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SKANIM_SSE2
+#include <emmintrin.h>
+#endif
+
+#endif
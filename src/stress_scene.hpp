@@ -0,0 +1,1116 @@
+#ifndef STRESS_SCENE_H
+#define STRESS_SCENE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "animation.hpp"
+#include "animation_layers.hpp"
+#include "animation_lod.hpp"
+#include "bounds.hpp"
+#include "frame_ring.hpp"
+#include "frame_stats.hpp"
+#include "model.hpp"
+#include "model_loader.hpp"
+#include "occlusion.hpp"
+#include "pose_cache.hpp"
+#include "profiler.hpp"
+#include "render_queue.hpp"
+#include "root_motion.hpp"
+#include "shader.hpp"
+#include "texture_manager.hpp"
+#include "timing.hpp"
+#include "worker_pool.hpp"
+
+// Stress scene: many animated instances of several characters, laid out on a grid or at
+// random, each playing its own clip with its own phase, seen from a camera that follows a
+// fixed orbit. Everything is derived from the options and a seed, so two runs with the same
+// flags render the same workload. Far instances update their pose at a lower rate (see
+// animation_lod.hpp), and the instances whose posed bounds are out of view are neither
+// evaluated nor drawn. Poses are a function of the scene time, so a hidden instance keeps
+// playing and shows the right pose the frame it comes back into view. Optional walls occlude
+// the crowd, through a CPU depth buffer (see occlusion.hpp).
+
+// culling bounds grow by this fraction of their size on every side
+const float CULL_MARGIN = 0.1f;
+// instances per culling job
+const unsigned int CULL_CHUNK = 256;
+// visible instances per job writing palettes into the ring buffer
+const unsigned int PALETTE_CHUNK = 64;
+
+enum class SceneLayout
+{
+    Grid,
+    Random
+};
+
+// most worker threads --cull-threads accepts
+const unsigned int MAX_CULL_THREADS = 256;
+
+struct SceneOptions
+{
+    std::string AssetsDirectory;
+    // asset name (assets/<name>.fbx + .png) and number of instances, e.g. "zombie=1000,man=500"
+    std::vector<std::pair<std::string, unsigned int> > Assets;
+    SceneLayout Layout;
+    // distance between two neighbour instances on the grid, the random layout covers the same area
+    float Spacing;
+    unsigned int Seed;
+    AnimationLodSettings AnimationLod;
+    // frustum culling of the instances against their animated bounds
+    bool Cull;
+    // culled instances evaluate their pose every N frames, 0 only when they are visible again or
+    // their joints are queried (see StressScene::SetHiddenUpdateInterval)
+    unsigned int HiddenUpdateInterval;
+    // walls scattered over the scene, and whether they occlude the instances behind them
+    unsigned int Walls;
+    bool Occlusion;
+    // worker threads for culling, in addition to the main one
+    unsigned int CullThreads;
+    // sort the draws by program, material and depth rather than draw in instance order
+    bool SortDraws;
+    // layers over the base clip of every animated model, played in step with it
+    std::vector<LayerDesc> Layers;
+    // clips play in place and the instances walk along their root motion
+    bool RootMotion;
+    // seconds of clip time the instances sharing a pose may be apart, 0 evaluates every instance
+    float PoseCacheStep;
+
+    SceneOptions() : AssetsDirectory("../assets"), Layout(SceneLayout::Grid), Spacing(4.0f), Seed(1), Cull(true), HiddenUpdateInterval(0),
+        Walls(0), Occlusion(true), CullThreads(std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0),
+        SortDraws(true), RootMotion(false), PoseCacheStep(0.0f) {}
+
+    bool ParseAssets(const std::string& list)
+    {
+        Assets.clear();
+        std::stringstream stream(list);
+        std::string item;
+        while (std::getline(stream, item, ','))
+        {
+            size_t equals = item.find('=');
+            std::string name = item.substr(0, equals);
+            int count = equals != std::string::npos ? std::atoi(item.c_str() + equals + 1) : 1;
+            if (name.empty() || count <= 0)
+                return false;
+            Assets.push_back(std::make_pair(name, (unsigned int)count));
+        }
+        return !Assets.empty();
+    }
+};
+
+// CPU time spent by the scene in every stage, summed over the frames
+struct SceneStageTimes
+{
+    double Lod;
+    double Sampling;
+    double Hierarchy;
+    double Palette;
+    double Blend;
+    double Cull;
+    // building the draws of a pipelined frame, on the simulation thread
+    double Prepare;
+    // occluder rasterization, part of Cull
+    double Rasterize;
+    double Draw;
+    unsigned int Frames;
+    // instance-frames culled (outside the view or occluded), occluded, and culled without evaluating the pose
+    uint64_t Culled;
+    uint64_t Occluded;
+    uint64_t Skipped;
+    // instance-frames spent in every animation LOD tier
+    uint64_t Tiers[ANIMATION_LOD_TIERS];
+    // and at every skeleton LOD
+    uint64_t SkeletonLods[SKELETON_LOD_LEVELS];
+    // and at every mesh LOD
+    uint64_t MeshLods[MESH_LOD_LEVELS];
+
+    SceneStageTimes() : Lod(0.0), Sampling(0.0), Hierarchy(0.0), Palette(0.0), Blend(0.0), Cull(0.0), Prepare(0.0), Rasterize(0.0), Draw(0.0), Frames(0), Culled(0), Occluded(0), Skipped(0)
+    {
+        for (unsigned int i = 0; i < ANIMATION_LOD_TIERS; i++)
+            Tiers[i] = 0;
+        for (unsigned int i = 0; i < SKELETON_LOD_LEVELS; i++)
+            SkeletonLods[i] = 0;
+        for (unsigned int i = 0; i < MESH_LOD_LEVELS; i++)
+            MeshLods[i] = 0;
+    }
+};
+
+class StressScene
+{
+    public:
+        // number of frames the camera takes to orbit the scene once
+        static const unsigned int CAMERA_PATH_FRAMES = 600;
+
+        StressScene() : extent(0.0f), cull(true), occlusion(true), wallTransform(1.0f), sortDraws(true), paletteSlot(nullptr), wallMaterial(0), wallVertexArray(0), testOcclusion(false), time(0.0f),
+            rootMotion(false), motionTime(-1.0f), simulating(false) {}
+
+        // loads every asset once and places its instances, needs a GL context
+        bool Load(const SceneOptions& options)
+        {
+            lod = options.AnimationLod;
+            cull = options.Cull;
+            occlusion = options.Occlusion;
+            sortDraws = options.SortDraws;
+            rootMotion = options.RootMotion;
+            poseCache.SetStep(options.PoseCacheStep);
+            pool.reset(new WorkerPool(options.CullThreads));
+            unsigned int total = 0;
+            for (unsigned int a = 0; a < options.Assets.size(); a++)
+            {
+                std::string path = options.AssetsDirectory + "/" + options.Assets[a].first;
+                ModelLoadOptions loadOptions;
+                loadOptions.Residency = ResidencyPolicy::ReleaseAfterUpload;
+                // distant instances draw the simplified meshes
+                loadOptions.MeshLodLevels = MESH_LOD_LEVELS - 1;
+                loadOptions.ExtractRootMotion = options.RootMotion;
+                models.push_back(LoadModelFromFilename(path + ".fbx", loadOptions));
+                textures.push_back(TextureRef(TextureManager::Get().Acquire(path + ".png", GL_CLAMP_TO_EDGE, GL_NEAREST, GL_NEAREST)));
+                if (models.back().GetMeshes().empty())
+                {
+                    std::cout << "ERROR::SCENE: Failed to load " << path << ".fbx" << std::endl;
+                    return false;
+                }
+                // bounding sphere of the bind pose, used to estimate the screen size of the instances
+                const Model& model = models.back();
+                BoundingSphere bounds;
+                bounds.Center = (model.GetBoundsMin() + model.GetBoundsMax()) * 0.5f;
+                bounds.Radius = glm::length(model.GetBoundsMax() - model.GetBoundsMin()) * 0.5f;
+                modelBounds.push_back(bounds);
+                total += options.Assets[a].second;
+
+                layerStacks.push_back(LayerStack());
+                if (!model.HasAnimations() || options.Layers.empty())
+                    continue;
+                layerStacks.back() = LayerStack(model.GetSkeleton());
+                for (unsigned int l = 0; l < options.Layers.size(); l++)
+                {
+                    const LayerDesc& layer = options.Layers[l];
+                    if (layer.Clip >= model.GetNumAnimations())
+                        std::cout << "ERROR::SCENE: " << options.Assets[a].first << " has no clip " << layer.Clip << " to layer" << std::endl;
+                    else
+                        layerStacks.back().AddLayer(model.GetSkeleton(), model.GetAnimation(layer.Clip), layer.Blend, layer.Joints, layer.Weight);
+                }
+                layerTimes.resize(std::max((unsigned int)layerTimes.size(), layerStacks.back().GetNumLayers()));
+            }
+
+            // the grid is square, the random layout scatters the instances over the same area
+            unsigned int side = (unsigned int)std::ceil(std::sqrt((float)total));
+            extent = side * options.Spacing;
+            unsigned int seed = options.Seed;
+            instances.resize(total);
+            unsigned int index = 0;
+            for (unsigned int a = 0; a < options.Assets.size(); a++)
+            {
+                const Model& model = models[a];
+                for (unsigned int i = 0; i < options.Assets[a].second; i++, index++)
+                {
+                    SceneInstance& instance = instances[index];
+                    instance.ModelIndex = a;
+                    instance.Clip = model.HasAnimations() ? random(seed) % model.GetNumAnimations() : 0;
+                    instance.TimeOffset = model.HasAnimations() ? randomFloat(seed) * clipLength(model.GetAnimation(instance.Clip)) : 0.0f;
+
+                    glm::vec2 position;
+                    if (options.Layout == SceneLayout::Grid)
+                        position = glm::vec2((index % side) + 0.5f, (index / side) + 0.5f) * options.Spacing;
+                    else
+                        position = glm::vec2(randomFloat(seed), randomFloat(seed)) * extent;
+                    position -= glm::vec2(extent * 0.5f);
+                    float yaw = randomFloat(seed) * 2.0f * glm::pi<float>();
+                    instance.Transform = glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(position.x, 0.0f, position.y)), yaw, glm::vec3(0.0f, 1.0f, 0.0f));
+                    instance.InstancePose.Resize(model.GetSkeleton());
+                    instance.PreviousPalette.resize(model.GetSkeleton().GetNumBones());
+                    instance.BlendedPalette.resize(model.GetSkeleton().GetNumBones());
+                    instance.DrawPalette = &instance.InstancePose.Palette;
+                    instance.PaletteOffset = -1;
+                    instance.Tier = 0;
+                    instance.SkeletonLod = 0;
+                    instance.MeshLod = 0;
+                    instance.Visible = true;
+                    instance.HiddenUpdateInterval = options.HiddenUpdateInterval;
+                    instance.PoseTime = -1.0f;
+                    instance.PoseSkeletonLod = 0;
+                    instance.FramesSinceUpdate = 0;
+                    instance.SampleTime = 0.0f;
+                    instance.PoseSource = -1;
+                    instance.Evaluated = false;
+                    instance.Evaluate = false;
+                }
+            }
+            cullCounts.resize((total + CULL_CHUNK - 1) / CULL_CHUNK);
+            drawList.reserve(total);
+
+            // room for every palette, should all the instances be visible
+            size_t paletteBytes = 0;
+            for (unsigned int m = 0; m < models.size(); m++)
+            {
+                unsigned int bones = models[m].GetSkeleton().GetNumBones();
+                if (bones > MAX_BONES)
+                    std::cout << "ERROR::SCENE: " << options.Assets[m].first << " has " << bones << " bones, the shader takes " << MAX_BONES << std::endl;
+                if (models[m].HasAnimations())
+                    paletteBytes += (size_t)std::min(bones, MAX_BONES) * sizeof(glm::mat4) * options.Assets[m].second;
+            }
+            if (!palettes.Init(GL_UNIFORM_BUFFER, paletteBytes, total, BONES_BLOCK_BYTES))
+                return false;
+            // pipelined frames write the persistent ring directly, the orphaned one needs the palettes staged
+            for (unsigned int f = 0; f < 2; f++)
+            {
+                if (!palettes.IsPersistent())
+                    frames[f].Palettes.resize(palettes.GetFrameBytes());
+                frames[f].Head.store(0);
+                frames[f].Region = 0;
+            }
+
+            // walls as tall as the tallest character and a half
+            if (options.Walls > 0)
+            {
+                float height = 0.0f;
+                for (unsigned int m = 0; m < models.size(); m++)
+                    height = std::max(height, models[m].GetBoundsMax().y * 1.5f);
+                std::vector<BoundingBox> walls = Occlusion::ScatterWalls(options.Walls, extent, options.Spacing, height, options.Seed);
+                for (unsigned int w = 0; w < walls.size(); w++)
+                    occluders.AddBox(walls[w].Min, walls[w].Max);
+                wallMesh.reset(new Mesh(buildWallMesh(walls)));
+            }
+            assignMaterials();
+
+            std::cout << "Stress scene: " << total << " instances of " << models.size() << " models over "
+                      << extent << " x " << extent << " units, " << options.Walls << " walls" << std::endl;
+            return true;
+        }
+
+        // evaluates the pose of the visible instances due this frame, one stage at a time across the
+        // crowd, and blends the others. camera and tanHalfFovY size the instances on screen for the LOD.
+        // Call Cull first: the culled instances are skipped, unless they have a hidden update interval.
+        void Update(float timeInSeconds, unsigned int frame, const glm::vec3& camera, float tanHalfFovY)
+        {
+            PROFILE_SCOPE("StressScene::Update");
+            Timer timer;
+            time = timeInSeconds;
+            uint64_t tierCounts[ANIMATION_LOD_TIERS] = { 0, 0, 0, 0 };
+            uint64_t skeletonLodCounts[SKELETON_LOD_LEVELS] = { 0, 0, 0, 0 };
+            uint64_t meshLodCounts[MESH_LOD_LEVELS] = { 0, 0, 0, 0 };
+            uint64_t skipped = 0;
+            for (unsigned int i = 0; i < instances.size(); i++)
+            {
+                SceneInstance& instance = instances[i];
+                instance.Evaluate = false;
+                if (!instance.Visible)
+                {
+                    // nothing to blend from when it shows up again, its next visible frame evaluates
+                    instance.Evaluated = false;
+                    unsigned int hiddenInterval = instance.HiddenUpdateInterval;
+                    if (hiddenInterval == 0 || !models[instance.ModelIndex].HasAnimations() || (frame + i) % hiddenInterval != 0)
+                    {
+                        skipped++;
+                        continue;
+                    }
+                }
+                const BoundingSphere& bounds = modelBounds[instance.ModelIndex];
+                glm::vec3 center = glm::vec3(instance.Transform * glm::vec4(bounds.Center, 1.0f));
+                float screenFraction = AnimationLod::ProjectedScreenFraction(center, bounds.Radius, camera, tanHalfFovY);
+                instance.MeshLod = lod.SelectMeshLod(screenFraction);
+                meshLodCounts[instance.MeshLod]++;
+                if (!models[instance.ModelIndex].HasAnimations())
+                    continue;
+                instance.Tier = lod.SelectTier(screenFraction);
+                instance.SkeletonLod = lod.SelectSkeletonLod(screenFraction);
+                skeletonLodCounts[instance.SkeletonLod]++;
+                tierCounts[instance.Tier]++;
+
+                // the instances of a tier are spread over its interval, so every frame costs about the same
+                unsigned int interval = AnimationLodSettings::UpdateInterval(instance.Tier);
+                instance.Evaluate = !instance.Evaluated || instance.FramesSinceUpdate + 1 >= interval || (frame + i) % interval == 0;
+                instance.FramesSinceUpdate = instance.Evaluate ? 0 : instance.FramesSinceUpdate + 1;
+            }
+            // the instances due with the same model, clip, skeleton LOD and time step share the pose of the first one
+            if (poseCache.IsEnabled())
+            {
+                poseCache.BeginFrame((unsigned int)instances.size());
+                for (unsigned int i = 0; i < instances.size(); i++)
+                {
+                    SceneInstance& instance = instances[i];
+                    if (!instance.Evaluate)
+                        continue;
+                    const AnimationClip& clip = models[instance.ModelIndex].GetAnimation(instance.Clip);
+                    unsigned int step = poseCache.Quantize(clip, timeInSeconds + instance.TimeOffset, instance.SampleTime);
+                    unsigned int source = poseCache.Find(MakePoseCacheKey(instance.ModelIndex, instance.Clip, instance.SkeletonLod, step), i);
+                    instance.PoseSource = source != i ? (int)source : -1;
+                }
+                poseCache.EndFrame();
+            }
+            else
+                for (unsigned int i = 0; i < instances.size(); i++)
+                    instances[i].SampleTime = timeInSeconds + instances[i].TimeOffset;
+            for (unsigned int t = 0; t < ANIMATION_LOD_TIERS; t++)
+            {
+                times.Tiers[t] += tierCounts[t];
+                FRAME_STAT_ADD((FrameCounter)(COUNTER_ANIMATION_TIER_0 + t), tierCounts[t]);
+            }
+            for (unsigned int l = 0; l < SKELETON_LOD_LEVELS; l++)
+                times.SkeletonLods[l] += skeletonLodCounts[l];
+            for (unsigned int l = 0; l < MESH_LOD_LEVELS; l++)
+                times.MeshLods[l] += meshLodCounts[l];
+            times.Skipped += skipped;
+            times.Lod += timer.ElapsedMilliseconds();
+
+            timer.Reset();
+            for (unsigned int i = 0; i < instances.size(); i++)
+            {
+                SceneInstance& instance = instances[i];
+                if (!instance.Evaluate || instance.PoseSource >= 0)
+                    continue;
+                const Model& model = models[instance.ModelIndex];
+                const AnimationClip& clip = model.GetAnimation(instance.Clip);
+                const Skeleton& skeleton = model.GetSkeleton();
+                if (layerStacks[instance.ModelIndex].GetNumLayers() > 0)
+                    sampleLayered(instance, instance.SampleTime);
+                else
+                    Animation::SampleLocalPose(skeleton, skeleton.Lods[instance.SkeletonLod], clip, Animation::ClipTime(clip, instance.SampleTime), instance.InstancePose.Local);
+            }
+            times.Sampling += timer.ElapsedMilliseconds();
+
+            timer.Reset();
+            for (unsigned int i = 0; i < instances.size(); i++)
+            {
+                SceneInstance& instance = instances[i];
+                if (!instance.Evaluate)
+                    continue;
+                if (instance.PoseSource >= 0)
+                {
+                    // no Global of its own, GetJointTransform evaluates it when asked
+                    instance.PoseTime = -1.0f;
+                    continue;
+                }
+                const Skeleton& skeleton = models[instance.ModelIndex].GetSkeleton();
+                Animation::EvaluateHierarchy(skeleton, skeleton.Lods[instance.SkeletonLod], instance.InstancePose.Local, instance.InstancePose.Global);
+                instance.PoseTime = timeInSeconds;
+                instance.PoseSkeletonLod = instance.SkeletonLod;
+            }
+            times.Hierarchy += timer.ElapsedMilliseconds();
+
+            timer.Reset();
+            for (unsigned int i = 0; i < instances.size(); i++)
+            {
+                SceneInstance& instance = instances[i];
+                if (!instance.Evaluate)
+                    continue;
+                // the last evaluated palette becomes the previous one, without copying
+                instance.PreviousPalette.swap(instance.InstancePose.Palette);
+                const Skeleton& skeleton = models[instance.ModelIndex].GetSkeleton();
+                // the source comes first, so its palette is already built
+                if (instance.PoseSource >= 0)
+                    instance.InstancePose.Palette = instances[instance.PoseSource].InstancePose.Palette;
+                else
+                    Animation::BuildPalette(skeleton, skeleton.Lods[instance.SkeletonLod], instance.InstancePose.Global, instance.InstancePose.Palette);
+                if (!instance.Evaluated)
+                    instance.PreviousPalette = instance.InstancePose.Palette;
+                // a hidden update isn't blended from either
+                instance.Evaluated = instance.Visible;
+            }
+            times.Palette += timer.ElapsedMilliseconds();
+
+            // tier 0 shows the pose it just evaluated, the others move from the previous evaluation to
+            // the last one over their interval, so the pose is continuous when the next update lands
+            timer.Reset();
+            for (unsigned int i = 0; i < instances.size(); i++)
+            {
+                SceneInstance& instance = instances[i];
+                if (!instance.Visible)
+                    continue;
+                unsigned int interval = AnimationLodSettings::UpdateInterval(instance.Tier);
+                if (interval == 1)
+                    instance.DrawPalette = &instance.InstancePose.Palette;
+                else if (instance.FramesSinceUpdate == 0)
+                    instance.DrawPalette = &instance.PreviousPalette;
+                else
+                {
+                    float factor = std::min(1.0f, (float)instance.FramesSinceUpdate / interval);
+                    AnimationLod::BlendPalettes(instance.PreviousPalette, instance.InstancePose.Palette, factor, instance.BlendedPalette);
+                    instance.DrawPalette = &instance.BlendedPalette;
+                }
+            }
+            times.Blend += timer.ElapsedMilliseconds();
+            times.Frames++;
+        }
+
+        // how far an instance's clip carries it between two scene times, read from the root motion track
+        // alone; nothing when the scene plays its clips in place
+        RootMotionDelta GetDisplacement(unsigned int index, float fromSeconds, float toSeconds) const
+        {
+            const SceneInstance& instance = instances[index];
+            const Model& model = models[instance.ModelIndex];
+            if (!rootMotion || !model.HasAnimations())
+                return RootMotionDelta();
+            return RootMotion::Between(model.GetRootMotion(instance.Clip), fromSeconds + instance.TimeOffset, toSeconds + instance.TimeOffset);
+        }
+
+        // walks every instance, hidden or not, along its root motion up to timeInSeconds, before Cull.
+        // An instance leaving the scene comes back in on the other side.
+        void Advance(float timeInSeconds)
+        {
+            if (!rootMotion)
+                return;
+            PROFILE_SCOPE("StressScene::Advance");
+            if (motionTime >= 0.0f && timeInSeconds > motionTime)
+            {
+                float half = extent * 0.5f;
+                for (unsigned int i = 0; i < instances.size(); i++)
+                {
+                    SceneInstance& instance = instances[i];
+                    const Model& model = models[instance.ModelIndex];
+                    if (!model.HasAnimations() || model.GetRootMotion(instance.Clip).IsEmpty())
+                        continue;
+                    RootMotionDelta delta = GetDisplacement(i, motionTime, timeInSeconds);
+                    instance.Transform = RootMotion::Apply(model.GetRootMotion(instance.Clip), instance.Transform, delta);
+                    glm::vec4& position = instance.Transform[3];
+                    position.x += position.x > half ? -extent : (position.x < -half ? extent : 0.0f);
+                    position.z += position.z > half ? -extent : (position.z < -half ? extent : 0.0f);
+                }
+            }
+            motionTime = timeInSeconds;
+        }
+
+        // tests the bounds of every instance against the view, before Update so the culled instances
+        // skip their pose evaluation, palette upload and draw. The bounds come from the last pose drawn,
+        // or the bind pose after a skipped frame, grown by CULL_MARGIN for the motion since.
+        // With walls, the ones in view are rasterized first and the boxes in the frustum are tested
+        // against them. Both steps run on the worker pool.
+        void Cull(const glm::mat4& viewProjection)
+        {
+            PROFILE_SCOPE("StressScene::Cull");
+            Timer timer;
+            if (!cull)
+            {
+                for (unsigned int i = 0; i < instances.size(); i++)
+                    instances[i].Visible = true;
+                times.Cull += timer.ElapsedMilliseconds();
+                return;
+            }
+
+            frustum = Frustum(viewProjection);
+            testOcclusion = occlusion && occluders.GetNumTriangles() > 0;
+            if (testOcclusion)
+            {
+                PROFILE_SCOPE("Rasterize occluders");
+                Timer rasterizeTimer;
+                occluders.Render(viewProjection, *pool);
+                times.Rasterize += rasterizeTimer.ElapsedMilliseconds();
+                FRAME_STAT_ADD(COUNTER_OCCLUDER_TRIANGLES, occluders.GetNumTriangles());
+            }
+
+            CullChunk job(*this);
+            pool->Run((unsigned int)cullCounts.size(), job);
+            uint64_t culled = 0, occluded = 0;
+            for (unsigned int c = 0; c < cullCounts.size(); c++)
+            {
+                culled += cullCounts[c].Culled;
+                occluded += cullCounts[c].Occluded;
+            }
+            times.Culled += culled;
+            times.Occluded += occluded;
+            FRAME_STAT_ADD(COUNTER_INSTANCES_CULLED, culled);
+            FRAME_STAT_ADD(COUNTER_INSTANCES_OCCLUDED, occluded);
+            times.Cull += timer.ElapsedMilliseconds();
+        }
+
+        // low-rate pose updates while culled, for instances with attachments or events; 0 (the default)
+        // evaluates them only when they are visible again or GetJointTransform asks for a joint
+        void SetHiddenUpdateInterval(unsigned int index, unsigned int frames) { instances[index].HiddenUpdateInterval = frames; }
+
+        // world transform of a joint of an instance at the time of the last Update. Evaluated here
+        // (full skeleton, no palette) when the instance was skipped, copied the pose of another one
+        // or its skeleton LOD left the joint out. It writes the pose of the instance, so it must not
+        // be called while a pipelined Simulate runs.
+        glm::mat4 GetJointTransform(unsigned int index, unsigned int joint)
+        {
+            SceneInstance& instance = instances[index];
+            const Model& model = models[instance.ModelIndex];
+            const Skeleton& skeleton = model.GetSkeleton();
+            if (simulating)
+            {
+                std::cout << "ERROR::SCENE: GetJointTransform called while Simulate runs" << std::endl;
+                return instance.Transform;
+            }
+            if (instance.PoseTime != time || !skeleton.Lods[instance.PoseSkeletonLod].Keep[joint])
+            {
+                float sampleTime = sampleTimeOf(instance);
+                if (layerStacks[instance.ModelIndex].GetNumLayers() > 0)
+                    sampleLayered(instance, sampleTime);
+                else if (model.HasAnimations())
+                {
+                    const AnimationClip& clip = model.GetAnimation(instance.Clip);
+                    Animation::SampleLocalPose(skeleton, clip, Animation::ClipTime(clip, sampleTime), instance.InstancePose.Local);
+                }
+                else
+                    for (unsigned int j = 0; j < skeleton.Joints.size(); j++)
+                        instance.InstancePose.Local[j] = skeleton.Joints[j].LocalTransform;
+                Animation::EvaluateHierarchy(skeleton, instance.InstancePose.Local, instance.InstancePose.Global);
+                instance.PoseTime = time;
+                instance.PoseSkeletonLod = 0;
+            }
+            return instance.Transform * skeleton.GlobalInverseTransform * instance.InstancePose.Global[joint];
+        }
+
+        // compares GetJointTransform for every joint of every instance with a full evaluation of the
+        // pose (EvaluatePose, or the layers over the whole skeleton) at the time Update sampled it.
+        // The error is relative to the magnitude of each element, at least 1.
+        bool CheckJointTransforms(std::ostream& out, float tolerance)
+        {
+            Pose reference;
+            LayerScratch scratch;
+            std::vector<float> referenceLayerTimes;
+            float worst = 0.0f;
+            unsigned int worstInstance = 0, worstJoint = 0;
+            uint64_t joints = 0;
+            for (unsigned int i = 0; i < instances.size(); i++)
+            {
+                const SceneInstance& instance = instances[i];
+                const Model& model = models[instance.ModelIndex];
+                const Skeleton& skeleton = model.GetSkeleton();
+                const LayerStack& layers = layerStacks[instance.ModelIndex];
+                float sampleTime = sampleTimeOf(instance);
+                reference.Resize(skeleton);
+                if (layers.GetNumLayers() > 0)
+                {
+                    referenceLayerTimes.assign(layers.GetNumLayers(), sampleTime);
+                    layers.Evaluate(model.GetAnimation(instance.Clip), sampleTime, referenceLayerTimes.data(), scratch, reference.Local);
+                    Animation::EvaluateHierarchy(skeleton, reference.Local, reference.Global);
+                }
+                else if (model.HasAnimations())
+                    Animation::EvaluatePose(skeleton, model.GetAnimation(instance.Clip), sampleTime, reference);
+                else
+                {
+                    for (unsigned int j = 0; j < skeleton.Joints.size(); j++)
+                        reference.Local[j] = skeleton.Joints[j].LocalTransform;
+                    Animation::EvaluateHierarchy(skeleton, reference.Local, reference.Global);
+                }
+
+                for (unsigned int j = 0; j < skeleton.Joints.size(); j++, joints++)
+                {
+                    glm::mat4 expected = instance.Transform * skeleton.GlobalInverseTransform * reference.Global[j];
+                    glm::mat4 actual = GetJointTransform(i, j);
+                    for (int c = 0; c < 4; c++)
+                    {
+                        for (int r = 0; r < 4; r++)
+                        {
+                            float error = std::fabs(actual[c][r] - expected[c][r]) / std::max(1.0f, std::fabs(expected[c][r]));
+                            if (!(error <= worst))
+                            {
+                                worst = error;
+                                worstInstance = i;
+                                worstJoint = j;
+                            }
+                        }
+                    }
+                }
+            }
+
+            bool passed = worst <= tolerance;
+            out << (passed ? "PASS" : "FAIL") << " joint transforms: " << joints << " joints of " << instances.size()
+                << " instances, max relative error " << worst;
+            if (!passed)
+                out << " at instance " << worstInstance << ", joint " << worstJoint;
+            out << " (tolerance " << tolerance << ")" << std::endl;
+            return passed;
+        }
+
+        // the shader must be in use with the view and projection already set. Queues the meshes of
+        // the visible instances and the walls, sorted unless disabled, and submits them. camera
+        // orders the draws front to back within a material.
+        void Draw(const Shader& shader, const glm::vec3& camera)
+        {
+            PROFILE_SCOPE("StressScene::Draw");
+            Timer timer;
+            {
+                PROFILE_SCOPE("Write palettes");
+                palettes.BeginFrame();
+                writePalettes(nullptr);
+                palettes.EndWrites();
+            }
+            buildQueue(queue, transforms, camera);
+            queue.Submit(shader);
+            palettes.EndFrame();
+            times.Draw += timer.ElapsedMilliseconds();
+        }
+
+        // Pipelined frames: Simulate culls, updates and prepares the draws of a frame on the
+        // simulation thread, into one of two slots, while Submit draws the slot of the previous
+        // frame on the render thread. Simulate doesn't call GL. With a persistently mapped ring,
+        // BeginSimulate opens the ring region of the frame on the render thread (waiting for its
+        // fence) and Simulate writes the palettes straight into it. Orphaning would take the
+        // storage the previous frame's draws read, and a mapped buffer can't be drawn from, so
+        // there the palettes are staged in the slot and Submit copies them into the ring.
+        void BeginSimulate(unsigned int slot)
+        {
+            if (palettes.IsPersistent())
+                frames[slot % 2].Region = palettes.BeginFrame();
+        }
+
+        void Simulate(unsigned int slot, const glm::mat4& projection, const glm::mat4& view, const glm::vec3& camera,
+                      float tanHalfFovY, float timeInSeconds, unsigned int frame)
+        {
+            simulating = true;
+            Advance(timeInSeconds);
+            Cull(projection * view);
+            Update(timeInSeconds, frame, camera, tanHalfFovY);
+
+            PROFILE_SCOPE("StressScene::Prepare");
+            Timer timer;
+            FrameData& data = frames[slot % 2];
+            data.Projection = projection;
+            data.View = view;
+            writePalettes(palettes.IsPersistent() ? nullptr : &data);
+            buildQueue(data.Queue, data.Transforms, camera);
+            times.Prepare += timer.ElapsedMilliseconds();
+            simulating = false;
+        }
+
+        // draws the slot Simulate filled, with the camera it was simulated for
+        void Submit(unsigned int slot, const Shader& shader)
+        {
+            PROFILE_SCOPE("StressScene::Submit");
+            Timer timer;
+            FrameData& data = frames[slot % 2];
+            shader.SetMatrix4("projection", data.Projection);
+            shader.SetMatrix4("view", data.View);
+            if (palettes.IsPersistent())
+            {
+                // the palette offsets point into the region BeginSimulate opened
+                data.Queue.Submit(shader);
+                palettes.EndFrame(data.Region);
+                times.Draw += timer.ElapsedMilliseconds();
+                return;
+            }
+            palettes.BeginFrame();
+            size_t bytes = std::min(data.Head.load(), data.Palettes.size());
+            RingAllocation allocation = palettes.Allocate(bytes);
+            if (allocation.Data != nullptr && bytes > 0)
+                std::memcpy(allocation.Data, &data.Palettes[0], bytes);
+            palettes.EndWrites();
+            if (allocation.Data != nullptr)
+                data.Queue.Submit(shader, allocation.Offset);
+            palettes.EndFrame();
+            times.Draw += timer.ElapsedMilliseconds();
+        }
+
+        // releases the GL objects the scene owns beside its models, while the context is alive
+        void Shutdown() { palettes.Shutdown(); }
+
+        // the camera circles the scene once every CAMERA_PATH_FRAMES frames, looking at its centre
+        glm::vec3 GetCameraPosition(unsigned int frame) const
+        {
+            float angle = 2.0f * glm::pi<float>() * (frame % CAMERA_PATH_FRAMES) / CAMERA_PATH_FRAMES;
+            float radius = extent * 0.75f + 8.0f;
+            return glm::vec3(std::sin(angle) * radius, extent * 0.4f + 6.0f, std::cos(angle) * radius);
+        }
+
+        glm::mat4 GetCameraView(unsigned int frame) const
+        {
+            return glm::lookAt(GetCameraPosition(frame), glm::vec3(0.0f, 5.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        }
+
+        // far enough to see the far side of the scene from the camera path
+        float GetFarPlane() const { return std::max(100.0f, extent * 2.5f + 20.0f); }
+
+        unsigned int GetNumInstances() const { return (unsigned int)instances.size(); }
+        const SceneStageTimes& GetStageTimes() const { return times; }
+
+        void PrintStageTimes(std::ostream& out) const
+        {
+            if (times.Frames == 0)
+                return;
+            out << "Stress scene CPU time per frame: lod " << times.Lod / times.Frames << " ms, sampling " << times.Sampling / times.Frames
+                << " ms, hierarchy " << times.Hierarchy / times.Frames << " ms, palette " << times.Palette / times.Frames << " ms, blend "
+                << times.Blend / times.Frames << " ms, cull " << times.Cull / times.Frames << " ms, prepare " << times.Prepare / times.Frames
+                << " ms, draw " << times.Draw / times.Frames << " ms" << std::endl;
+            out << "Culled instances per frame: " << (double)times.Culled / times.Frames << " of " << instances.size()
+                << " (occluded " << (double)times.Occluded / times.Frames << "), not evaluated " << (double)times.Skipped / times.Frames
+                << ", occluder rasterization " << times.Rasterize / times.Frames << " ms" << std::endl;
+            out << "Animation LOD instances per frame:";
+            for (unsigned int t = 0; t < ANIMATION_LOD_TIERS; t++)
+                out << " every " << AnimationLodSettings::UpdateInterval(t) << " frame(s) " << (double)times.Tiers[t] / times.Frames;
+            out << std::endl;
+            out << "Skeleton LOD instances per frame:";
+            for (unsigned int l = 0; l < SKELETON_LOD_LEVELS; l++)
+                out << " level " << l << " " << (double)times.SkeletonLods[l] / times.Frames;
+            out << std::endl;
+            out << "Mesh LOD instances per frame:";
+            for (unsigned int l = 0; l < MESH_LOD_LEVELS; l++)
+                out << " level " << l << " " << (double)times.MeshLods[l] / times.Frames;
+            out << std::endl;
+            poseCache.PrintSummary(out);
+            palettes.PrintSummary(out, "Palette ring buffer");
+        }
+
+    private:
+        struct SceneInstance
+        {
+            unsigned int ModelIndex;
+            unsigned int Clip;
+            float TimeOffset; // seconds
+            glm::mat4 Transform;
+            Pose InstancePose;
+            // palette evaluated before the one in InstancePose, and the blend of the two
+            std::vector<glm::mat4> PreviousPalette;
+            std::vector<glm::mat4> BlendedPalette;
+            // what the instance draws with this frame, one of the three palettes
+            const std::vector<glm::mat4>* DrawPalette;
+            // where Draw wrote DrawPalette in the palette ring buffer this frame, -1 when it didn't fit
+            GLintptr PaletteOffset;
+            unsigned int Tier;
+            unsigned int SkeletonLod;
+            unsigned int MeshLod;
+            bool Visible;   // after Cull
+            unsigned int HiddenUpdateInterval;
+            // scene time and skeleton LOD of InstancePose.Global
+            float PoseTime;
+            unsigned int PoseSkeletonLod;
+            unsigned int FramesSinceUpdate;
+            // seconds the pose is sampled at this frame: the scene time plus the offset, or with the
+            // pose cache the start of its step in the first loop of the clip
+            float SampleTime;
+            // the instance whose palette this one copies this frame, -1 when it evaluates its own
+            int PoseSource;
+            bool Evaluated; // at least once
+            bool Evaluate;  // this frame
+        };
+
+        struct BoundingSphere
+        {
+            glm::vec3 Center;
+            float Radius;
+        };
+
+        std::vector<Model> models;
+        std::vector<BoundingSphere> modelBounds;
+        // the layers of each model, none for the models played without
+        std::vector<LayerStack> layerStacks;
+        // scratch of the layered sampling, which runs on one thread
+        LayerScratch layerScratch;
+        std::vector<float> layerTimes;
+        // the texture of each model, same index
+        std::vector<TextureRef> textures;
+        std::vector<SceneInstance> instances;
+        float extent;
+        AnimationLodSettings lod;
+        bool cull;
+        bool occlusion;
+        std::unique_ptr<WorkerPool> pool;
+        OcclusionBuffer occluders;
+        std::unique_ptr<Mesh> wallMesh;
+        glm::mat4 wallTransform;
+        bool sortDraws;
+        RenderQueue queue;
+        std::vector<glm::mat4> transforms;
+        FrameRingBuffer palettes;
+        // indices of the visible instances, in instance order
+        std::vector<unsigned int> drawList;
+        // what Submit needs of a frame Simulate prepared, one slot being drawn while the other fills
+        struct FrameData
+        {
+            glm::mat4 Projection;
+            glm::mat4 View;
+            RenderQueue Queue;
+            // model transforms of the packets, the instances move on meanwhile
+            std::vector<glm::mat4> Transforms;
+            // the palettes staged for an orphaned ring, aligned as in the ring, and the bytes used
+            std::vector<char> Palettes;
+            std::atomic<size_t> Head;
+            // of the persistent ring, written by Simulate and fenced once Submit has drawn the slot
+            unsigned int Region;
+        };
+        FrameData frames[2];
+        // the slot writePalettes fills, nullptr for the ring buffer
+        FrameData* paletteSlot;
+        // material index of each mesh of each model, the same for meshes drawn with the same textures
+        std::vector<std::vector<unsigned int> > meshMaterials;
+        unsigned int wallMaterial;
+        // index of the vertex array of each mesh of each model in the sort keys, the walls come last
+        std::vector<std::vector<unsigned int> > meshVertexArrays;
+        unsigned int wallVertexArray;
+        // state of the Cull in progress, for the jobs
+        Frustum frustum;
+        bool testOcclusion;
+        struct CullCounts
+        {
+            uint64_t Culled;
+            uint64_t Occluded;
+        };
+        // one entry per CULL_CHUNK instances
+        std::vector<CullCounts> cullCounts;
+        // of the last Update
+        float time;
+        bool rootMotion;
+        // of the last Advance, -1 before the first
+        float motionTime;
+        PoseCache poseCache;
+        // set while Simulate runs on the pipeline thread, GetJointTransform is refused meanwhile
+        std::atomic<bool> simulating;
+        SceneStageTimes times;
+
+        // small LCG, so the placement doesn't depend on the standard library
+        static unsigned int random(unsigned int& seed)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            return seed >> 8;
+        }
+
+        static float randomFloat(unsigned int& seed) { return (float)random(seed) / (float)(1 << 24); }
+
+        static float clipLength(const AnimationClip& clip) { return clip.Duration / clip.TicksPerSecond; }
+
+        // the clip time (in seconds) Update samples an instance at: the scene time plus its offset,
+        // moved to the start of its step when the pose cache is on
+        float sampleTimeOf(const SceneInstance& instance) const
+        {
+            float sampleTime = time + instance.TimeOffset;
+            const Model& model = models[instance.ModelIndex];
+            if (poseCache.IsEnabled() && model.HasAnimations())
+                poseCache.Quantize(model.GetAnimation(instance.Clip), time + instance.TimeOffset, sampleTime);
+            return sampleTime;
+        }
+
+        // local pose of the whole skeleton from the base clip and the layers of the model, all at
+        // instanceTime (the scene time plus the offset of the instance)
+        void sampleLayered(SceneInstance& instance, float instanceTime)
+        {
+            const Model& model = models[instance.ModelIndex];
+            const LayerStack& layers = layerStacks[instance.ModelIndex];
+            for (unsigned int l = 0; l < layers.GetNumLayers(); l++)
+                layerTimes[l] = instanceTime;
+            layers.Evaluate(model.GetAnimation(instance.Clip), instanceTime, layerTimes.data(), layerScratch, instance.InstancePose.Local);
+        }
+
+        // numbers the distinct texture sets: the scene texture of the model then those of the mesh
+        // and the vertex arrays, in the order of the meshes, so the sort keys hold small indices rather than GL names
+        void assignMaterials()
+        {
+            std::vector<std::vector<GLuint> > materials;
+            unsigned int vertexArrays = 0;
+            meshMaterials.resize(models.size());
+            meshVertexArrays.resize(models.size());
+            for (unsigned int m = 0; m < models.size(); m++)
+            {
+                const std::vector<Mesh>& meshes = models[m].GetMeshes();
+                meshMaterials[m].resize(meshes.size());
+                meshVertexArrays[m].resize(meshes.size());
+                for (unsigned int i = 0; i < meshes.size(); i++)
+                {
+                    std::vector<GLuint> set(1, textures[m].ID());
+                    for (unsigned int t = 0; t < meshes[i].GetTextures().size(); t++)
+                        set.push_back(meshes[i].GetTextures()[t].ID);
+                    meshMaterials[m][i] = findMaterial(materials, set);
+                    meshVertexArrays[m][i] = vertexArrays++;
+                }
+            }
+            wallMaterial = findMaterial(materials, std::vector<GLuint>(1, 0));
+            wallVertexArray = vertexArrays++;
+            if (materials.size() > SORT_KEY_MATERIALS || vertexArrays > SORT_KEY_VERTEX_ARRAYS)
+                std::cout << "WARNING::SCENE: " << materials.size() << " materials and " << vertexArrays
+                          << " vertex arrays don't fit the sort keys, some draws won't be grouped" << std::endl;
+        }
+
+        static unsigned int findMaterial(std::vector<std::vector<GLuint> >& materials, const std::vector<GLuint>& set)
+        {
+            for (unsigned int i = 0; i < materials.size(); i++)
+                if (materials[i] == set)
+                    return i;
+            materials.push_back(set);
+            return (unsigned int)materials.size() - 1;
+        }
+
+        // lists the visible instances and copies their palettes on the worker pool, into the frame
+        // open in the ring buffer or, with a slot, aside into the slot
+        void writePalettes(FrameData* slot)
+        {
+            drawList.clear();
+            for (unsigned int i = 0; i < instances.size(); i++)
+                if (instances[i].Visible)
+                    drawList.push_back(i);
+            paletteSlot = slot;
+            if (slot != nullptr)
+                slot->Head.store(0);
+            PaletteChunk job(*this);
+            pool->Run(((unsigned int)drawList.size() + PALETTE_CHUNK - 1) / PALETTE_CHUNK, job);
+            paletteSlot = nullptr;
+        }
+
+        struct PaletteChunk
+        {
+            StressScene& scene;
+
+            explicit PaletteChunk(StressScene& scene) : scene(scene) {}
+
+            void operator()(unsigned int chunk) const { scene.writePaletteChunk(chunk); }
+        };
+
+        void writePaletteChunk(unsigned int chunk)
+        {
+            size_t alignment = palettes.GetAlignment();
+            unsigned int end = std::min((unsigned int)drawList.size(), (chunk + 1) * PALETTE_CHUNK);
+            for (unsigned int d = chunk * PALETTE_CHUNK; d < end; d++)
+            {
+                SceneInstance& instance = instances[drawList[d]];
+                instance.PaletteOffset = -1;
+                if (!models[instance.ModelIndex].HasAnimations())
+                    continue;
+                const std::vector<glm::mat4>& palette = *instance.DrawPalette;
+                size_t bytes = std::min(palette.size(), (size_t)MAX_BONES) * sizeof(glm::mat4);
+                if (paletteSlot != nullptr)
+                {
+                    // laid out as the ring buffer would, so one copy moves the whole slot
+                    size_t size = (bytes + alignment - 1) / alignment * alignment;
+                    size_t offset = paletteSlot->Head.fetch_add(size);
+                    if (offset + size > paletteSlot->Palettes.size())
+                        continue;
+                    std::memcpy(&paletteSlot->Palettes[offset], &palette[0], bytes);
+                    instance.PaletteOffset = (GLintptr)offset;
+                    continue;
+                }
+                RingAllocation allocation = palettes.Allocate(bytes);
+                if (allocation.Data == nullptr)
+                    continue;
+                std::memcpy(allocation.Data, &palette[0], bytes);
+                instance.PaletteOffset = allocation.Offset;
+            }
+        }
+
+        // the packets of the visible instances with a palette, and of the walls, sorted unless disabled.
+        // The packets point at the copy of the instance transforms in packetTransforms. The queue is
+        // submitted with a single shader, program 0 of the keys.
+        void buildQueue(RenderQueue& target, std::vector<glm::mat4>& packetTransforms, const glm::vec3& camera)
+        {
+            target.Clear();
+            packetTransforms.resize(drawList.size());
+            float farPlane = GetFarPlane();
+            for (unsigned int d = 0; d < drawList.size(); d++)
+            {
+                const SceneInstance& instance = instances[drawList[d]];
+                const Model& model = models[instance.ModelIndex];
+                if (model.HasAnimations() && instance.PaletteOffset < 0)
+                    continue;
+                const std::vector<Mesh>& meshes = model.GetMeshes();
+                float depth = glm::length(glm::vec3(instance.Transform[3]) - camera) / farPlane;
+                packetTransforms[d] = instance.Transform;
+                for (unsigned int m = 0; m < meshes.size(); m++)
+                {
+                    DrawPacket packet;
+                    packet.Key = MakeSortKey(RenderPass::Opaque, 0, meshMaterials[instance.ModelIndex][m], depth, meshVertexArrays[instance.ModelIndex][m]);
+                    packet.DrawMesh = &meshes[m];
+                    packet.Lod = instance.MeshLod;
+                    packet.Texture = textures[instance.ModelIndex].ID();
+                    packet.Transform = &packetTransforms[d];
+                    packet.PaletteBuffer = model.HasAnimations() ? palettes.GetBuffer() : 0;
+                    packet.PaletteOffset = instance.PaletteOffset;
+                    target.Push(packet);
+                }
+            }
+            if (wallMesh)
+            {
+                // one untextured draw for every wall
+                DrawPacket packet;
+                packet.Key = MakeSortKey(RenderPass::Opaque, 0, wallMaterial, 0.0f, wallVertexArray);
+                packet.DrawMesh = wallMesh.get();
+                packet.Lod = 0;
+                packet.Texture = 0;
+                packet.Transform = &wallTransform;
+                packet.PaletteBuffer = 0;
+                packet.PaletteOffset = 0;
+                target.Push(packet);
+            }
+            if (sortDraws)
+                target.Sort();
+        }
+
+        struct CullChunk
+        {
+            StressScene& scene;
+
+            explicit CullChunk(StressScene& scene) : scene(scene) {}
+
+            void operator()(unsigned int chunk) const { scene.cullChunk(chunk); }
+        };
+
+        void cullChunk(unsigned int chunk)
+        {
+            CullCounts counts = { 0, 0 };
+            unsigned int end = std::min((unsigned int)instances.size(), (chunk + 1) * CULL_CHUNK);
+            for (unsigned int i = chunk * CULL_CHUNK; i < end; i++)
+            {
+                SceneInstance& instance = instances[i];
+                const Model& model = models[instance.ModelIndex];
+                BoundingBox bounds;
+                if (model.HasAnimations() && instance.Evaluated)
+                    bounds = Bounds::AnimatedBounds(model.GetSkeleton(), *instance.DrawPalette);
+                if (bounds.IsEmpty())
+                    bounds = BoundingBox(model.GetBoundsMin(), model.GetBoundsMax());
+                glm::vec3 margin = (bounds.Max - bounds.Min) * CULL_MARGIN;
+                bounds.Min -= margin;
+                bounds.Max += margin;
+                BoundingBox world = Bounds::TransformBox(instance.Transform, bounds);
+                instance.Visible = frustum.Intersects(world);
+                if (instance.Visible && testOcclusion && occluders.IsOccluded(world))
+                {
+                    instance.Visible = false;
+                    counts.Occluded++;
+                }
+                counts.Culled += instance.Visible ? 0 : 1;
+            }
+            cullCounts[chunk] = counts;
+        }
+
+        // six faces of four vertices per wall, facing out
+        static Mesh buildWallMesh(const std::vector<BoundingBox>& walls)
+        {
+            std::vector<Vertex> vertices;
+            std::vector<unsigned int> indices;
+            for (unsigned int w = 0; w < walls.size(); w++)
+            {
+                glm::vec3 center = (walls[w].Min + walls[w].Max) * 0.5f, half = (walls[w].Max - walls[w].Min) * 0.5f;
+                for (unsigned int axis = 0; axis < 3; axis++)
+                {
+                    for (int side = -1; side <= 1; side += 2)
+                    {
+                        glm::vec3 normal(0.0f), u(0.0f), v(0.0f);
+                        normal[axis] = (float)side;
+                        u[(axis + 1) % 3] = half[(axis + 1) % 3];
+                        v[(axis + 2) % 3] = half[(axis + 2) % 3];
+                        glm::vec3 faceCenter = center + normal * half[axis];
+                        unsigned int base = (unsigned int)vertices.size();
+                        for (unsigned int corner = 0; corner < 4; corner++)
+                        {
+                            Vertex vertex;
+                            vertex.Position = faceCenter + u * (corner & 1 ? 1.0f : -1.0f) + v * (corner & 2 ? 1.0f : -1.0f);
+                            vertex.Normal = normal;
+                            vertex.TexCoords = glm::vec2(0.0f);
+                            vertex.BoneIDs = glm::ivec4(0);
+                            vertex.BoneWeights = glm::vec4(0.0f);
+                            vertices.push_back(vertex);
+                        }
+                        unsigned int quad[6] = { 0, 1, 3, 0, 3, 2 };
+                        for (unsigned int k = 0; k < 6; k++)
+                            indices.push_back(base + (side > 0 ? quad[k] : quad[5 - k]));
+                    }
+                }
+            }
+            return Mesh(std::move(vertices), std::move(indices), std::vector<Texture>(), "walls");
+        }
+};
+
+#endif
@@ -0,0 +1,335 @@
+#ifndef TEXTURE_MANAGER_H
+#define TEXTURE_MANAGER_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "frame_stats.hpp"
+#include "import_report.hpp"
+#include "texture.hpp"
+
+// Handle to a texture owned by the TextureManager. The generation guards against
+// stale handles once a slot has been released and reused by another image.
+struct TextureHandle
+{
+    unsigned int Index;
+    unsigned int Generation;
+
+    TextureHandle() : Index(InvalidIndex), Generation(0) {}
+    TextureHandle(unsigned int index, unsigned int generation) : Index(index), Generation(generation) {}
+
+    bool IsValid() const { return Index != InvalidIndex; }
+
+    static const unsigned int InvalidIndex = 0xFFFFFFFF;
+};
+
+// Process-wide texture registry: every image is loaded once, keyed by the hash of its
+// normalized path, and shared (reference counted) by all the models and instances using it.
+class TextureManager
+{
+    public:
+        static TextureManager& Get()
+        {
+            static TextureManager instance;
+            return instance;
+        }
+
+        // returns a handle to the texture at path, loading it on first use. The caller owns one reference.
+        // Sampler parameters are only applied when the image is loaded, later requests share the first one.
+        // A load is timed (decode, upload) into the optional report.
+        TextureHandle Acquire(const std::string& path, GLuint wrap = GL_REPEAT, GLuint filterMin = GL_NEAREST_MIPMAP_NEAREST, GLuint filterMag = GL_NEAREST,
+            ImportReport* report = nullptr)
+        {
+            std::string normalized = NormalizePath(path);
+            uint64_t hash = HashPath(normalized);
+
+            std::unordered_map<uint64_t, unsigned int>::iterator it = lookup.find(hash);
+            if (it != lookup.end())
+            {
+                // the key holds the first path with this hash, the others are found by comparing the paths
+                unsigned int shared = entries[it->second].Path == normalized ? it->second : findPath(hash, normalized);
+                if (shared != TextureHandle::InvalidIndex)
+                {
+                    entries[shared].RefCount++;
+                    return TextureHandle(shared, entries[shared].Generation);
+                }
+            }
+
+            unsigned int index;
+            if (!freeList.empty())
+            {
+                index = freeList.back();
+                freeList.pop_back();
+            }
+            else
+            {
+                index = (unsigned int)entries.size();
+                entries.push_back(Entry());
+            }
+
+            Entry& entry = entries[index];
+            entry.Hash = hash;
+            entry.Path = normalized;
+            entry.RefCount = 1;
+            loadFromFile(entry, wrap, filterMin, filterMag, report);
+
+            if (it == lookup.end())
+                lookup[hash] = index;
+
+            return TextureHandle(index, entry.Generation);
+        }
+
+        void AddRef(TextureHandle handle)
+        {
+            if (isLive(handle))
+                entries[handle.Index].RefCount++;
+        }
+
+        // drops one reference, the GL texture is deleted when nobody uses it anymore
+        void Release(TextureHandle handle)
+        {
+            if (!isLive(handle))
+                return;
+
+            Entry& entry = entries[handle.Index];
+            if (--entry.RefCount > 0)
+                return;
+
+            glDeleteTextures(1, &entry.ID);
+            std::unordered_map<uint64_t, unsigned int>::iterator it = lookup.find(entry.Hash);
+            if (it != lookup.end() && it->second == handle.Index)
+            {
+                // hand the key over to another live texture with the same hash, if any
+                unsigned int other = findHash(entry.Hash, handle.Index);
+                if (other != TextureHandle::InvalidIndex)
+                    it->second = other;
+                else
+                    lookup.erase(it);
+            }
+            entry.ID = 0;
+            entry.Path.clear();
+            entry.Generation++;
+            freeList.push_back(handle.Index);
+        }
+
+        GLuint GetID(TextureHandle handle) const { return isLive(handle) ? entries[handle.Index].ID : 0; }
+        unsigned int GetRefCount(TextureHandle handle) const { return isLive(handle) ? entries[handle.Index].RefCount : 0; }
+        unsigned int GetNumTextures() const { return (unsigned int)(entries.size() - freeList.size()); }
+        std::string GetPath(TextureHandle handle) const { return isLive(handle) ? entries[handle.Index].Path : std::string(); }
+
+        // registry bookkeeping only, the decoded pixels are freed as soon as they are uploaded
+        size_t GetCPUBytes(TextureHandle handle) const
+        {
+            return isLive(handle) ? sizeof(Entry) + entries[handle.Index].Path.capacity() : 0;
+        }
+
+        // size of the uploaded image including its full mipmap chain
+        size_t GetGPUBytes(TextureHandle handle) const
+        {
+            if (!isLive(handle))
+                return 0;
+
+            const Entry& entry = entries[handle.Index];
+            size_t bytes = 0;
+            int width = entry.Width, height = entry.Height;
+            while (width > 0 && height > 0)
+            {
+                bytes += (size_t)width * height * entry.Components;
+                if (width == 1 && height == 1)
+                    break;
+                width = width > 1 ? width / 2 : 1;
+                height = height > 1 ? height / 2 : 1;
+            }
+            return bytes;
+        }
+
+        void Bind(TextureHandle handle) const
+        {
+            FRAME_STAT_ADD(COUNTER_STATE_CHANGES, 1);
+            glBindTexture(GL_TEXTURE_2D, GetID(handle));
+        }
+
+        // deletes every GL texture while the context is still alive; later releases become no-ops
+        void Shutdown()
+        {
+            for (unsigned int i = 0; i < entries.size(); i++)
+                if (entries[i].RefCount > 0)
+                    glDeleteTextures(1, &entries[i].ID);
+            entries.clear();
+            freeList.clear();
+            lookup.clear();
+        }
+
+        // makes different spellings of the same file ("a/./b/../c.png", "a\\c.png") map to the same key
+        static std::string NormalizePath(const std::string& path)
+        {
+            std::vector<std::string> parts;
+            std::string part;
+            bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+            for (size_t i = 0; i <= path.size(); i++)
+            {
+                char c = i < path.size() ? path[i] : '/';
+                if (c != '/' && c != '\\')
+                {
+                    part += c;
+                    continue;
+                }
+                if (part == "..")
+                {
+                    if (!parts.empty() && parts.back() != "..")
+                        parts.pop_back();
+                    else if (!absolute)
+                        parts.push_back(part);
+                }
+                else if (!part.empty() && part != ".")
+                    parts.push_back(part);
+                part.clear();
+            }
+
+            std::string normalized = absolute ? "/" : "";
+            for (unsigned int i = 0; i < parts.size(); i++)
+            {
+                if (i > 0)
+                    normalized += '/';
+                normalized += parts[i];
+            }
+            return normalized;
+        }
+
+        // 64-bit FNV-1a
+        static uint64_t HashPath(const std::string& path)
+        {
+            uint64_t hash = 14695981039346656037ULL;
+            for (unsigned int i = 0; i < path.size(); i++)
+            {
+                hash ^= (unsigned char)path[i];
+                hash *= 1099511628211ULL;
+            }
+            return hash;
+        }
+
+    private:
+        struct Entry
+        {
+            GLuint ID;
+            unsigned int RefCount;
+            unsigned int Generation;
+            uint64_t Hash;
+            std::string Path;
+            int Width, Height, Components;
+
+            Entry() : ID(0), RefCount(0), Generation(0), Hash(0), Width(0), Height(0), Components(0) {}
+        };
+
+        std::vector<Entry> entries;
+        std::vector<unsigned int> freeList;
+        std::unordered_map<uint64_t, unsigned int> lookup;
+
+        TextureManager() {}
+        TextureManager(const TextureManager&);
+        TextureManager& operator=(const TextureManager&);
+
+        bool isLive(TextureHandle handle) const
+        {
+            return handle.Index < entries.size() && entries[handle.Index].Generation == handle.Generation && entries[handle.Index].RefCount > 0;
+        }
+
+        // live texture other than skip whose path has this hash, a linear search for the rare hash collisions
+        unsigned int findHash(uint64_t hash, unsigned int skip) const
+        {
+            for (unsigned int i = 0; i < entries.size(); i++)
+                if (i != skip && entries[i].RefCount > 0 && entries[i].Hash == hash)
+                    return i;
+            return TextureHandle::InvalidIndex;
+        }
+
+        unsigned int findPath(uint64_t hash, const std::string& path) const
+        {
+            for (unsigned int i = 0; i < entries.size(); i++)
+                if (entries[i].RefCount > 0 && entries[i].Hash == hash && entries[i].Path == path)
+                    return i;
+            return TextureHandle::InvalidIndex;
+        }
+
+        void loadFromFile(Entry& entry, GLuint wrap, GLuint filterMin, GLuint filterMag, ImportReport* report)
+        {
+            glGenTextures(1, &entry.ID);
+
+            unsigned char* data;
+            {
+                ImportStageTimer timer(report, "texture decode");
+                data = stbi_load(entry.Path.c_str(), &entry.Width, &entry.Height, &entry.Components, 0);
+            }
+            if (data)
+            {
+                ImportStageTimer timer(report, "texture upload");
+                if (report)
+                {
+                    report->AddCount("textures", 1);
+                    report->AddCount("texture bytes", (uint64_t)entry.Width * entry.Height * entry.Components);
+                }
+
+                GLenum format;
+                if (entry.Components == 1)
+                    format = GL_RED;
+                else if (entry.Components == 3)
+                    format = GL_RGB;
+                else if (entry.Components == 4)
+                    format = GL_RGBA;
+                else
+                    format = GL_RED;
+
+                glBindTexture(GL_TEXTURE_2D, entry.ID);
+                glTexImage2D(GL_TEXTURE_2D, 0, format, entry.Width, entry.Height, 0, format, GL_UNSIGNED_BYTE, data);
+                glGenerateMipmap(GL_TEXTURE_2D);
+                FRAME_STAT_ADD(COUNTER_BYTES_UPLOADED, (uint64_t)entry.Width * entry.Height * entry.Components);
+
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filterMin);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filterMag);
+                glBindTexture(GL_TEXTURE_2D, 0);
+            }
+            else
+            {
+                std::cout << "Texture failed to load at path: " << entry.Path << std::endl;
+                entry.Width = entry.Height = entry.Components = 0;
+            }
+            stbi_image_free(data);
+        }
+};
+
+// Owns one reference to a managed texture, so models can be copied around and still
+// release their textures exactly once.
+class TextureRef
+{
+    public:
+        TextureRef() {}
+        explicit TextureRef(TextureHandle handle) : handle(handle) {}
+        TextureRef(const TextureRef& other) : handle(other.handle) { TextureManager::Get().AddRef(handle); }
+        ~TextureRef() { TextureManager::Get().Release(handle); }
+
+        TextureRef& operator=(const TextureRef& other)
+        {
+            if (this != &other)
+            {
+                TextureManager::Get().AddRef(other.handle);
+                TextureManager::Get().Release(handle);
+                handle = other.handle;
+            }
+            return *this;
+        }
+
+        TextureHandle Handle() const { return handle; }
+        GLuint ID() const { return TextureManager::Get().GetID(handle); }
+
+    private:
+        TextureHandle handle;
+};
+
+#endif
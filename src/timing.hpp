@@ -0,0 +1,65 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+// Wall clock stopwatch for CPU timings
+class Timer
+{
+    public:
+        Timer() : start(std::chrono::steady_clock::now()) {}
+
+        void Reset() { start = std::chrono::steady_clock::now(); }
+
+        double ElapsedMilliseconds() const
+        {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+    private:
+        std::chrono::steady_clock::time_point start;
+};
+
+// Summary of a series of timings (or any other samples)
+struct SampleStats
+{
+    unsigned int Count;
+    double Min, Mean, P50, P90, P99, Max;
+
+    SampleStats() : Count(0), Min(0.0), Mean(0.0), P50(0.0), P90(0.0), P99(0.0), Max(0.0) {}
+
+    // nearest-rank percentiles, the samples are sorted in place
+    static SampleStats Compute(std::vector<double>& samples)
+    {
+        SampleStats stats;
+        if (samples.empty())
+            return stats;
+
+        std::sort(samples.begin(), samples.end());
+        stats.Count = (unsigned int)samples.size();
+        stats.Min = samples.front();
+        stats.Max = samples.back();
+        double sum = 0.0;
+        for (unsigned int i = 0; i < samples.size(); i++)
+            sum += samples[i];
+        stats.Mean = sum / samples.size();
+        stats.P50 = Percentile(samples, 0.50);
+        stats.P90 = Percentile(samples, 0.90);
+        stats.P99 = Percentile(samples, 0.99);
+        return stats;
+    }
+
+    // expects sorted samples
+    static double Percentile(const std::vector<double>& sorted, double fraction)
+    {
+        if (sorted.empty())
+            return 0.0;
+        size_t rank = (size_t)(fraction * sorted.size() + 0.999999);
+        rank = rank > 0 ? rank - 1 : 0;
+        return sorted[std::min(rank, sorted.size() - 1)];
+    }
+};
+
+#endif
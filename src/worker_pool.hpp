@@ -0,0 +1,109 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads for the per-frame parallel loops. Run hands out the indices of a
+// job to the workers and the calling thread, and returns once every index is done. Jobs are
+// passed by reference without type erasure through std::function, so a frame doesn't allocate.
+
+class WorkerPool
+{
+    public:
+        // threads in addition to the calling one, 0 runs every job on the caller
+        explicit WorkerPool(unsigned int threads = 0) : context(nullptr), invoke(nullptr), count(0), pending(0), generation(0), stopping(false)
+        {
+            next.store(0);
+            for (unsigned int i = 0; i < threads; i++)
+                workers.push_back(std::thread(&WorkerPool::workerLoop, this));
+        }
+
+        ~WorkerPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (unsigned int i = 0; i < workers.size(); i++)
+                workers[i].join();
+        }
+
+        // calls job(index) for every index in [0, count), in any order and on any thread
+        template <typename Job>
+        void Run(unsigned int jobs, Job& job)
+        {
+            if (workers.empty() || jobs <= 1)
+            {
+                for (unsigned int i = 0; i < jobs; i++)
+                    job(i);
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                context = &job;
+                invoke = &invokeJob<Job>;
+                count = jobs;
+                next.store(0);
+                pending = (unsigned int)workers.size();
+                generation++;
+            }
+            wake.notify_all();
+            runJobs();
+            std::unique_lock<std::mutex> lock(mutex);
+            while (pending > 0)
+                done.wait(lock);
+        }
+
+        unsigned int GetNumThreads() const { return (unsigned int)workers.size() + 1; }
+
+    private:
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        void* context;
+        void (*invoke)(void*, unsigned int);
+        unsigned int count;
+        std::atomic<unsigned int> next;
+        unsigned int pending;
+        unsigned int generation;
+        bool stopping;
+
+        WorkerPool(const WorkerPool&);
+        WorkerPool& operator=(const WorkerPool&);
+
+        template <typename Job>
+        static void invokeJob(void* job, unsigned int index) { (*(Job*)job)(index); }
+
+        void runJobs()
+        {
+            for (unsigned int i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+                invoke(context, i);
+        }
+
+        void workerLoop()
+        {
+            unsigned int seen = 0;
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true)
+            {
+                while (!stopping && generation == seen)
+                    wake.wait(lock);
+                if (stopping)
+                    return;
+                seen = generation;
+                lock.unlock();
+                runJobs();
+                lock.lock();
+                if (--pending == 0)
+                    done.notify_one();
+            }
+        }
+};
+
+#endif